@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2022 - 2023 OSM Group @ HPI, University of Potsdam
+ */
+
+// measures the compression of a rendered image by libpng, as done by the
+// buffered and streaming encoders of the png backend, against
+// parallel_deflate, as done by the parallel encoder, for 1, 2, 4, ... up to
+// the maximum number of OpenMP threads. the parallel output is inflated
+// again and checked against the input.
+//
+// usage: bench-png-encoders [width [height]]
+
+#include <png.h>
+#include <zlib.h>
+#include <omp.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "./deflate.h"
+#include "./pixels.h"
+
+// the rows rendered per thread and chunk, as in the png backend
+#define BENCH_ROWS_PER_THREAD 16
+
+// the share of pixels changing from one row to the next, in 1/1000
+#define BENCH_ROW_CHANGES 20
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// a frame per row and a page per pixel, as the png backend renders them:
+// runs of pages in the same state, mostly unchanged from one frame to the
+// next
+static std::vector<unsigned char> make_image(size_t width, size_t height) {
+    size_t stride = pixel_row_bytes(width);
+    std::vector<unsigned char> image(stride * height);
+    std::vector<unsigned> states(width);
+
+    unsigned seed = 1;
+    for (size_t x = 0; x < width;) {
+        unsigned state = PIXEL_STATE(rand_r(&seed) % 4);
+        size_t run = 1 + rand_r(&seed) % 64;
+        for (; run && x < width; --run, ++x) {
+            states[x] = state;
+        }
+    }
+
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            if ((unsigned)rand_r(&seed) % 1000 < BENCH_ROW_CHANGES) {
+                states[x] = PIXEL_STATE(rand_r(&seed) % 4);
+            }
+            set_pixel(image.data() + y * stride, x, states[x]);
+        }
+    }
+
+    return image;
+}
+
+static void append_output(png_structp png, png_bytep data, png_size_t length) {
+    std::vector<unsigned char> *out = (std::vector<unsigned char>*)png_get_io_ptr(png);
+    out->insert(out->end(), data, data + length);
+}
+
+// write the image row by row through libpng, which compresses on the
+// calling thread
+static int encode_libpng(const std::vector<unsigned char>& image, size_t width, size_t height,
+                         std::vector<unsigned char> *out) {
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop png_info = png ? png_create_info_struct(png) : NULL;
+    if (!png_info || setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, &png_info);
+        return 1;
+    }
+
+    png_set_write_fn(png, out, append_output, NULL);
+    png_set_IHDR(png, png_info, width, height, PIXEL_BIT_DEPTH, PNG_COLOR_TYPE_PALETTE,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+
+    png_color palette[PIXEL_PALETTE_SIZE] = {};
+    png_set_PLTE(png, png_info, palette, PIXEL_PALETTE_SIZE);
+    png_write_info(png, png_info);
+
+    size_t stride = pixel_row_bytes(width);
+    for (size_t y = 0; y < height; ++y) {
+        png_write_row(png, image.data() + y * stride);
+    }
+
+    png_write_end(png, png_info);
+    png_destroy_write_struct(&png, &png_info);
+
+    return 0;
+}
+
+// compress the unfiltered scanlines in chunks of rows, as the parallel
+// encoder does. scanlines receives the uncompressed input for checking.
+static int encode_parallel(const std::vector<unsigned char>& image, size_t width, size_t height,
+                           std::vector<unsigned char> *out,
+                           std::vector<unsigned char> *scanlines) {
+    size_t stride = pixel_row_bytes(width);
+    size_t scanline = stride + 1;
+    size_t thread_rows = std::max<size_t>(BENCH_ROWS_PER_THREAD,
+                                          (DEFLATE_MIN_BLOCK + scanline - 1) / scanline);
+    size_t chunk_rows = omp_get_max_threads() * thread_rows;
+    std::vector<unsigned char> chunk(chunk_rows * scanline);
+
+    parallel_deflate deflate;
+
+    for (size_t first = 0; first < height; first += chunk_rows) {
+        size_t count = std::min(chunk_rows, height - first);
+
+        for (size_t i = 0; i < count; ++i) {
+            chunk[i * scanline] = PNG_FILTER_VALUE_NONE;
+            memcpy(chunk.data() + i * scanline + 1, image.data() + (first + i) * stride, stride);
+        }
+        scanlines->insert(scanlines->end(), chunk.begin(), chunk.begin() + count * scanline);
+
+        if (deflate.compress(chunk.data(), count * scanline, first + count == height, out)
+                != 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    size_t width = argc > 1 ? strtoull(argv[1], NULL, 10) : 8192;
+    size_t height = argc > 2 ? strtoull(argv[2], NULL, 10) : 8192;
+    int max_threads = omp_get_max_threads();
+
+    std::vector<unsigned char> image = make_image(width, height);
+    printf("%zux%zu pixels, %zu bytes, %d threads available\n", width, height, image.size(),
+           max_threads);
+    printf("%-10s %8s %10s %12s\n", "encoder", "threads", "time [s]", "size [bytes]");
+
+    std::vector<unsigned char> png;
+    auto start = std::chrono::steady_clock::now();
+    if (encode_libpng(image, width, height, &png) != 0) {
+        fprintf(stderr, "error: libpng failed\n");
+        return 1;
+    }
+    printf("%-10s %8d %10.3f %12zu\n", "libpng", 1, seconds_since(start), png.size());
+
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        omp_set_num_threads(threads);
+
+        std::vector<unsigned char> compressed;
+        std::vector<unsigned char> scanlines;
+        start = std::chrono::steady_clock::now();
+        if (encode_parallel(image, width, height, &compressed, &scanlines) != 0) {
+            return 1;
+        }
+        double elapsed = seconds_since(start);
+
+        std::vector<unsigned char> inflated(scanlines.size());
+        uLongf inflated_size = inflated.size();
+        if (uncompress(inflated.data(), &inflated_size, compressed.data(), compressed.size())
+                != Z_OK || inflated_size != scanlines.size() || inflated != scanlines) {
+            fprintf(stderr, "error: the parallel output does not inflate to its input\n");
+            return 1;
+        }
+
+        printf("%-10s %8d %10.3f %12zu\n", "parallel", threads, elapsed, compressed.size());
+
+        if (threads < max_threads && threads * 2 > max_threads) {
+            threads = max_threads / 2;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2022 - 2023 OSM Group @ HPI, University of Potsdam
+ */
+
+// measures how aggregating VMA ranges scales with the number of ranges, for
+// range_set and for the sorted vector the backends kept before it, which
+// scanned for the insertion point and swept the whole vector for merges.
+//
+// usage: bench-range-set [max VMAs per frame]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "./range.h"
+
+// the number of frames every VMA appears in
+#define BENCH_FRAMES 4
+
+// the linear vector is not measured beyond this many VMAs per frame, its
+// quadratic time reaches minutes there
+#define BENCH_MAX_LINEAR 16000
+
+// insert into a sorted vector of ranges and merge overlapping or adjacent
+// ones, as the backends did before range_set
+static void insert_linear(std::vector<range> *ranges, range r) {
+    bool matched = false;
+    for (size_t j = 0; j < ranges->size(); ++j) {
+        if (r.lower > (*ranges)[j].upper) {
+            continue;
+        }
+
+        if ((*ranges)[j].intersects(r)) {
+            (*ranges)[j] |= r;
+            matched = true;
+            continue;
+        }
+
+        if (r.upper < (*ranges)[j].lower) {
+            if (!matched) {
+                ranges->insert(ranges->begin() + j, r);
+                matched = true;
+            }
+            break;
+        }
+    }
+    if (!matched) {
+        ranges->push_back(r);
+    }
+
+    for (size_t j = 1; j < ranges->size(); ++j) {
+        if ((*ranges)[j - 1].intersects((*ranges)[j])
+                || (*ranges)[j - 1].upper == (*ranges)[j].lower - 1) {
+            (*ranges)[j - 1] |= (*ranges)[j];
+            ranges->erase(ranges->begin() + j);
+            j--;
+        }
+    }
+}
+
+// n disjoint one-page VMAs per frame with gaps in between, shifted by a page
+// every other frame, as in a trace of many small mappings
+static std::vector<range> make_vmas(size_t n) {
+    std::vector<range> vmas;
+    for (size_t f = 0; f < BENCH_FRAMES; ++f) {
+        for (size_t v = 0; v < n; ++v) {
+            size_t page = 0x100000 + v * 3 + f % 2;
+            vmas.emplace_back(page, page);
+        }
+    }
+    return vmas;
+}
+
+template<typename Insert>
+static double measure(const std::vector<range>& vmas, Insert insert) {
+    auto start = std::chrono::steady_clock::now();
+    for (const range& r : vmas) {
+        insert(r);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+int main(int argc, char *argv[]) {
+    size_t max_vmas = argc > 1 ? strtoull(argv[1], NULL, 10) : 256000;
+
+    printf("%10s %10s %14s %14s\n", "vmas", "ranges", "range_set [s]", "linear [s]");
+
+    for (size_t n = 1000; n <= max_vmas; n *= 2) {
+        std::vector<range> vmas = make_vmas(n);
+
+        range_set set;
+        double set_time = measure(vmas, [&](range r) { set.insert(r); });
+
+        if (n > BENCH_MAX_LINEAR) {
+            printf("%10zu %10zu %14.4f %14s\n", vmas.size(), set.size(), set_time, "-");
+            continue;
+        }
+
+        std::vector<range> linear;
+        double linear_time = measure(vmas, [&](range r) { insert_linear(&linear, r); });
+
+        if (linear.size() != set.size()) {
+            fprintf(stderr, "error: %zu ranges in the set but %zu in the vector\n",
+                    set.size(), linear.size());
+            return 1;
+        }
+
+        printf("%10zu %10zu %14.4f %14.4f\n", vmas.size(), set.size(), set_time, linear_time);
+    }
+
+    return 0;
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2022 - 2023 OSM Group @ HPI, University of Potsdam
+ */
+
+#ifndef AGGREGATE_H_
+#define AGGREGATE_H_
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include <omp.h>
+
+// aggregate all frames of a trace in parallel. every thread folds a static
+// slice of the frames into its own accumulator with visit(T&, size_t frame),
+// the per-thread accumulators are then combined pairwise in log2(threads)
+// parallel rounds with merge(T& into, T& from).
+template<typename T, typename Visit, typename Merge>
+T aggregate_frames(size_t num_frames, Visit visit, Merge merge) {
+    std::vector<T> partial(omp_get_max_threads());
+
+    #pragma omp parallel
+    {
+        T& local = partial[omp_get_thread_num()];
+
+        #pragma omp for schedule(static)
+        for (size_t i = 0; i < num_frames; ++i) {
+            visit(local, i);
+        }
+    }
+
+    for (size_t stride = 1; stride < partial.size(); stride *= 2) {
+        #pragma omp parallel for
+        for (size_t i = 0; i < partial.size() - stride; i += 2 * stride) {
+            merge(partial[i], partial[i + stride]);
+        }
+    }
+
+    return std::move(partial[0]);
+}
+
+#endif  // AGGREGATE_H_
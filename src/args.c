@@ -4,6 +4,8 @@
 
 #include "./args.h"
 
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "./util.h"
@@ -17,11 +19,48 @@ static struct argp_option options[] = {
       "the output format to produce. smog-trace-converter tries to guess the output "
       "format you want from the file extension of the output file, but this flag can "
       "override this guess with an explicit choice.\nOptions are: parquet, png, "
-      "png-frames and histogram.", 0 },
+      "png-frames, apng, histogram, histogram-bin, histogram-parquet, summary and "
+      "tiles.", 0 },
+    { "encoder", 'e', "MODE", 0,
+      "how the png backend produces its image. buffered renders the whole image into "
+      "memory before compressing it, streaming renders and emits chunks of rows, "
+      "needing memory for only a few rows per thread, parallel additionally compresses "
+      "the chunks on all threads.\nOptions are: buffered (default), streaming and "
+      "parallel.", 0 },
+    { "dedup", 'd', "MODE", 0,
+      "what the png-frames and parquet backends do for frames identical to an earlier "
+      "frame. skip writes no output for them, link makes their output a symbolic link "
+      "to the output of the earlier frame.\nOptions are: none (default), skip and "
+      "link.", 0 },
+    { "layout", 'l', "MODE", 0,
+      "how the png-frames and apng backends place the pages in a frame. treemap gives "
+      "every range a rectangle of its own, hilbert places the pages along a hilbert "
+      "curve, keeping pages close in the address space close in the image.\nOptions "
+      "are: treemap (default) and hilbert.", 0 },
+    { "scratch-dir", 's', "DIR", 0,
+      "back the image of the buffered png encoder with a sparse temporary file in DIR "
+      "instead of memory, for images larger than the available memory", 0 },
+    { "max-width", 'W', "PIXELS", 0,
+      "limit the width of the png image. each pixel then covers a bin of consecutive "
+      "pages, colored by the reduction chosen with --reduce.", 0 },
+    { "max-height", 'H', "PIXELS", 0,
+      "limit the height of the png image. each pixel then covers a bin of consecutive "
+      "frames, colored by the reduction chosen with --reduce.", 0 },
+    { "reduce", 'r', "MODE", 0,
+      "how binned pixels are colored. max shows the most active state of any page in "
+      "the bin, dirty shows the fraction of dirty pages on a gradient from blue to red, "
+      "majority shows the most frequent state.\nOptions are: max (default), dirty and "
+      "majority.", 0 },
+    { "preview", 'p', 0, 0,
+      "render a quick preview with the png backend. only every k-th frame is read and "
+      "a single page is sampled per pixel, limiting the image to 1024x1024 pixels "
+      "unless --max-width or --max-height say otherwise. --reduce has no effect.", 0 },
     { "page-size", 'S', "SIZE", 0,
       "override the default system page size for size reporting", 0 },
     { "vma", 'f', "NAME", 0,
       "limit the output to a single VMA", 0 },
+    { "no-index", 'n', 0, 0,
+      "do not load or store the frame index in a TRACEFILE.idx sidecar file", 0 },
     { "verbose", 'v', 0, 0,
       "show additional output, pass multiple times for even more output", 1 },
     { 0 }
@@ -38,12 +77,85 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
                 arguments->output_format = OUTPUT_PNG;
             } else if (!strcmp(arg, "png-frames")) {
                 arguments->output_format = OUTPUT_PNG_FRAMES;
+            } else if (!strcmp(arg, "apng")) {
+                arguments->output_format = OUTPUT_APNG;
             } else if (!strcmp(arg, "histogram")) {
                 arguments->output_format = OUTPUT_HISTOGRAM;
+            } else if (!strcmp(arg, "histogram-bin")) {
+                arguments->output_format = OUTPUT_HISTOGRAM_BINARY;
+            } else if (!strcmp(arg, "histogram-parquet")) {
+                arguments->output_format = OUTPUT_HISTOGRAM_PARQUET;
+            } else if (!strcmp(arg, "summary")) {
+                arguments->output_format = OUTPUT_SUMMARY;
+            } else if (!strcmp(arg, "tiles")) {
+                arguments->output_format = OUTPUT_TILES;
             } else {
                 argp_error(state, "unsupported output format: %s", arg);
             }
             break;
+        case 'e':
+            if (!strcmp(arg, "buffered")) {
+                arguments->png_encoder = PNG_ENCODER_BUFFERED;
+            } else if (!strcmp(arg, "streaming")) {
+                arguments->png_encoder = PNG_ENCODER_STREAMING;
+            } else if (!strcmp(arg, "parallel")) {
+                arguments->png_encoder = PNG_ENCODER_PARALLEL;
+            } else {
+                argp_error(state, "unsupported encoder: %s", arg);
+            }
+            break;
+        case 'd':
+            if (!strcmp(arg, "none")) {
+                arguments->dedup = DEDUP_NONE;
+            } else if (!strcmp(arg, "skip")) {
+                arguments->dedup = DEDUP_SKIP;
+            } else if (!strcmp(arg, "link")) {
+                arguments->dedup = DEDUP_LINK;
+            } else {
+                argp_error(state, "unsupported dedup mode: %s", arg);
+            }
+            break;
+        case 'l':
+            if (!strcmp(arg, "treemap")) {
+                arguments->layout = LAYOUT_TREEMAP;
+            } else if (!strcmp(arg, "hilbert")) {
+                arguments->layout = LAYOUT_HILBERT;
+            } else {
+                argp_error(state, "unsupported layout: %s", arg);
+            }
+            break;
+        case 's':
+            arguments->scratch_dir = arg;
+            break;
+        case 'W':
+        case 'H': {
+            char *end;
+            errno = 0;
+            size_t pixels = strtoull(arg, &end, 0);
+            if (errno != 0 || *end != '\0' || !pixels)
+                argp_failure(state, 1, errno, "invalid %s: %s",
+                             key == 'W' ? "max-width" : "max-height", arg);
+            if (key == 'W') {
+                arguments->max_width = pixels;
+            } else {
+                arguments->max_height = pixels;
+            }
+            break;
+        }
+        case 'r':
+            if (!strcmp(arg, "max")) {
+                arguments->reduction = REDUCE_MAX;
+            } else if (!strcmp(arg, "dirty")) {
+                arguments->reduction = REDUCE_DIRTY;
+            } else if (!strcmp(arg, "majority")) {
+                arguments->reduction = REDUCE_MAJORITY;
+            } else {
+                argp_error(state, "unsupported reduction: %s", arg);
+            }
+            break;
+        case 'p':
+            arguments->preview = 1;
+            break;
         case 'f':
             arguments->filter_vma = arg;
             break;
@@ -53,6 +165,9 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
             if (errno != 0)
                 argp_failure(state, 1, errno, "invalid page-size: %s", arg);
             break;
+        case 'n':
+            arguments->no_index = 1;
+            break;
         case 'v':
             arguments->verbose++;
             break;
@@ -79,15 +194,27 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
             if (arguments->output_format == OUTPUT_UNKNOWN) {
                 char *ext = strrchr(arguments->output_file, '.');
                 if (ext != NULL && !strcmp(ext, ".parquet")) {
-                    arguments->output_format = OUTPUT_PARQUET;
+                    if (strstr(arguments->output_file, "%s")) {
+                        arguments->output_format = OUTPUT_PARQUET;
+                    } else {
+                        arguments->output_format = OUTPUT_HISTOGRAM_PARQUET;
+                    }
                 } else if (ext != NULL && !strcmp(ext, ".png")) {
                     if (strstr(arguments->output_file, "%s")) {
                         arguments->output_format = OUTPUT_PNG_FRAMES;
                     } else {
                         arguments->output_format = OUTPUT_PNG;
                     }
+                } else if (ext != NULL && !strcmp(ext, ".apng")) {
+                    arguments->output_format = OUTPUT_APNG;
                 } else if (ext != NULL && !strcmp(ext, ".txt")) {
                     arguments->output_format = OUTPUT_HISTOGRAM;
+                } else if (ext != NULL && !strcmp(ext, ".bin")) {
+                    arguments->output_format = OUTPUT_HISTOGRAM_BINARY;
+                } else if (ext != NULL && !strcmp(ext, ".csv")) {
+                    arguments->output_format = OUTPUT_SUMMARY;
+                } else if (ext != NULL && !strcmp(ext, ".dzi")) {
+                    arguments->output_format = OUTPUT_TILES;
                 }
             }
 
@@ -97,6 +224,12 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
                              "specify the output format explicitly.",
                              arguments->output_file);
             }
+
+            // the other encoders never hold the whole image, so there is
+            // nothing for a scratch file to back
+            if (arguments->scratch_dir && arguments->png_encoder != PNG_ENCODER_BUFFERED) {
+                argp_error(state, "--scratch-dir only applies to the buffered encoder");
+            }
             break;
 
         default:
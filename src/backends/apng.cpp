@@ -0,0 +1,372 @@
+/*
+ * Copyright (c) 2022 - 2023 OSM Group @ HPI, University of Potsdam
+ */
+
+#include "backends/apng.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#include <png.h>
+#include <omp.h>
+
+#include "./util.h"
+#include "./trace-iterator.h"
+#include "./pixels.h"
+#include "./range.h"
+#include "./layout.h"
+#include "./render.h"
+#include "./deflate.h"
+#include "./smog-trace-converter.h"
+
+// the number of frames each thread renders and compresses per batch
+#define APNG_FRAMES_PER_THREAD 4
+
+// the largest IDAT or fdAT chunk written
+#define APNG_CHUNK_SIZE (8 * 1024 * 1024)
+
+// see https://wiki.mozilla.org/APNG_Specification
+#define APNG_DISPOSE_OP_NONE 0
+#define APNG_BLEND_OP_SOURCE 0
+#define APNG_BLEND_OP_OVER 1
+
+// a frame of the animation, holding the part of the image that changed
+// since the previous frame
+struct apng_frame {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+    uint8_t blend_op;
+
+    std::vector<unsigned char> scanlines;
+    std::vector<unsigned char> compressed;
+    int result;
+};
+
+static void encode_frame(struct apng_frame *out, const unsigned char *image,
+                         const unsigned char *previous, size_t xres, size_t yres);
+
+static void write_frame(png_structp png, const struct apng_frame& frame, uint32_t *sequence,
+                        uint16_t delay_num, uint16_t delay_den, bool first);
+
+static void put_u32(unsigned char *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void put_u16(unsigned char *p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+// the time until the next frame, in milliseconds where that fits, seconds
+// otherwise
+static void frame_delay(uint64_t delta_usec, uint16_t *num, uint16_t *den) {
+    if (delta_usec / 1000 <= UINT16_MAX) {
+        *num = delta_usec / 1000;
+        *den = 1000;
+    } else {
+        *num = std::min<uint64_t>(delta_usec / 1000000, UINT16_MAX);
+        *den = 1;
+    }
+}
+
+int backend_apng(struct smog_tracefile *tracefile, const char *path) {
+    // aggregate address ranges
+    printf("Aggregating VMA Ranges:   ");
+    fflush(stdout);
+    range_set aggregate = aggregate_vma_ranges(tracefile);
+
+    std::vector<range> ranges = aggregate.ranges();
+    size_t total_vmem = aggregate.num_pages();
+
+    printf("found %zu ranges with %zu pages, sized %s\n", ranges.size(), total_vmem,
+           format_size_string(total_vmem * arguments.page_size));
+
+    if (ranges.empty() || !tracefile->num_frames) {
+        fprintf(stderr, "no ranges to print. exiting now.\n");
+        return 1;
+    }
+
+    // the frames share the layout of png-frames
+    range_index index(ranges);
+    std::unique_ptr<page_layout> layout = make_page_layout(ranges, arguments.layout);
+
+    size_t xres = layout->width();
+    size_t yres = layout->height();
+
+    printf("Placing ranges in a %zux%zu pixel %s\n", xres, yres,
+           arguments.layout == LAYOUT_HILBERT ? "hilbert curve" : "treemap");
+
+    // prepare output file
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!png) {
+        fprintf(stderr, "%s: ", path);
+        perror("png_write_create_struct");
+        return 1;
+    }
+
+    png_set_user_limits(png, 0x7fffffff, 0x7fffffff);
+
+    png_infop png_info = png_create_info_struct(png);
+    if (!png_info) {
+        fprintf(stderr, "%s: ", path);
+        perror("png_create_info_struct");
+        png_destroy_write_struct(&png, NULL);
+        return 1;
+    }
+
+    FILE *png_fp = fopen(path, "wb");
+    if (png_fp == NULL) {
+        fprintf(stderr, "%s: ", path);
+        perror("fopen");
+        png_destroy_write_struct(&png, &png_info);
+        return 1;
+    }
+    png_init_io(png, png_fp);
+    png_set_IHDR(png,
+                 png_info,
+                 xres,
+                 yres,
+                 PIXEL_BIT_DEPTH,
+                 PNG_COLOR_TYPE_PALETTE,
+                 PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_BASE,
+                 PNG_FILTER_TYPE_BASE);
+
+    // the palette of the still images, followed by the transparent index
+    png_color palette[PIXEL_PALETTE_SIZE + 1] = {};
+    png_byte alpha[PIXEL_PALETTE_SIZE + 1];
+    for (size_t i = 0; i < PIXEL_PALETTE_SIZE; ++i) {
+        palette[i].red = pixel_palette[i][0];
+        palette[i].green = pixel_palette[i][1];
+        palette[i].blue = pixel_palette[i][2];
+        alpha[i] = 255;
+    }
+    alpha[PIXEL_TRANSPARENT] = 0;
+
+    png_set_PLTE(png, png_info, palette, PIXEL_PALETTE_SIZE + 1);
+    png_set_tRNS(png, png_info, alpha, PIXEL_PALETTE_SIZE + 1, NULL);
+    png_write_info(png, png_info);
+
+    // the animation control chunk, looping forever
+    unsigned char actl[8];
+    put_u32(actl, tracefile->num_frames);
+    put_u32(actl + 4, 0);
+    png_write_chunk(png, (png_const_bytep)"acTL", actl, sizeof(actl));
+
+    printf("Writing output frames:    0%%");
+    fflush(stdout);
+
+    // render and compress batches of frames on all threads, then write them
+    // in order. every frame is compared to the one before it, the first
+    // image holds the last frame of the previous batch. a frame is only
+    // compared once all images of the batch are rendered, as the one before
+    // it may be rendered by another thread.
+    size_t stride = pixel_row_bytes(xres);
+    size_t batch = omp_get_max_threads() * APNG_FRAMES_PER_THREAD;
+    std::vector<std::vector<unsigned char>> images(batch + 1);
+    std::vector<struct apng_frame> frames(batch);
+    std::vector<deflate_stream> streams(omp_get_max_threads());
+
+    uint32_t sequence = 0;
+    int res = 0;
+
+    for (size_t first = 0; first < tracefile->num_frames && !res; first += batch) {
+        size_t count = std::min<size_t>(batch, tracefile->num_frames - first);
+
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < count; ++i) {
+            std::vector<unsigned char>& image = images[i + 1];
+            image.assign(stride * yres, 0);
+            render_frame_layout(image.data(), stride, index, *layout,
+                                trace_frame(tracefile, first + i));
+        }
+
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < count; ++i) {
+            // the first frame of the animation is drawn in full
+            const unsigned char *previous = (first + i) ? images[i].data() : NULL;
+            struct apng_frame& frame = frames[i];
+            encode_frame(&frame, images[i + 1].data(), previous, xres, yres);
+
+            deflate_stream& stream = streams[omp_get_thread_num()];
+            frame.result = stream.compress(frame.scanlines.data(), frame.scanlines.size(),
+                                           &frame.compressed);
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            if (frames[i].result != Z_OK) {
+                fprintf(stderr, "%s: deflate: %s\n", path, zError(frames[i].result));
+                res = 1;
+                break;
+            }
+
+            // each frame lasts until the next one was recorded
+            size_t j = first + i;
+            uint64_t delta = 0;
+            if (j + 1 < tracefile->num_frames) {
+                delta = tracefile->frame_timestamps[j + 1] - tracefile->frame_timestamps[j];
+            } else if (j) {
+                delta = tracefile->frame_timestamps[j] - tracefile->frame_timestamps[j - 1];
+            }
+
+            uint16_t delay_num, delay_den;
+            frame_delay(delta, &delay_num, &delay_den);
+
+            write_frame(png, frames[i], &sequence, delay_num, delay_den, j == 0);
+        }
+
+        std::swap(images[0], images[count]);
+
+        printf("\rWriting output frames:    %zu%%", (first + count) * 100 / tracefile->num_frames);
+        fflush(stdout);
+    }
+
+    if (res != 0) {
+        printf("\n");
+        png_destroy_write_struct(&png, &png_info);
+        fclose(png_fp);
+        return 1;
+    }
+
+    png_write_chunk(png, (png_const_bytep)"IEND", NULL, 0);
+
+    printf("\rWriting output frames:    100%%\n");
+
+    png_destroy_write_struct(&png, &png_info);
+    if (fclose(png_fp) != 0) {
+        fprintf(stderr, "%s: ", path);
+        perror("fclose");
+        return 1;
+    }
+
+    printf("Successfully created %zux%zu pixel animation of %zu frames.\n", xres, yres,
+           tracefile->num_frames);
+
+    return 0;
+}
+
+// find the bounding box of the bytes that differ from the previous image and
+// produce its scanlines, drawing unchanged pixels transparent. the box starts
+// on a whole byte, so that the pixels need no shifting.
+static void encode_frame(struct apng_frame *out, const unsigned char *image,
+                         const unsigned char *previous, size_t xres, size_t yres) {
+    size_t stride = pixel_row_bytes(xres);
+
+    size_t top = 0, bottom = yres, left = 0, right = stride;
+    if (previous) {
+        while (top < yres && !memcmp(image + top * stride, previous + top * stride, stride)) {
+            top++;
+        }
+
+        if (top == yres) {
+            // nothing changed, draw a single transparent pixel
+            out->x = out->y = 0;
+            out->width = out->height = 1;
+            out->blend_op = APNG_BLEND_OP_OVER;
+            out->scanlines.assign({ PNG_FILTER_VALUE_NONE, PIXEL_TRANSPARENT << 4 });
+            return;
+        }
+
+        while (!memcmp(image + (bottom - 1) * stride, previous + (bottom - 1) * stride,
+                       stride)) {
+            bottom--;
+        }
+
+        left = stride;
+        right = 0;
+        for (size_t y = top; y < bottom; ++y) {
+            const unsigned char *row = image + y * stride;
+            const unsigned char *prev = previous + y * stride;
+
+            size_t l = 0;
+            while (l < left && row[l] == prev[l]) {
+                l++;
+            }
+            left = l;
+
+            size_t r = stride;
+            while (r > right && row[r - 1] == prev[r - 1]) {
+                r--;
+            }
+            right = r;
+        }
+    }
+
+    out->x = left * 2;
+    out->y = top;
+    out->width = std::min(right * 2, xres) - left * 2;
+    out->height = bottom - top;
+    out->blend_op = previous ? APNG_BLEND_OP_OVER : APNG_BLEND_OP_SOURCE;
+
+    size_t width = right - left;
+    size_t scanline = width + 1;
+    out->scanlines.resize(scanline * out->height);
+
+    for (size_t y = 0; y < out->height; ++y) {
+        unsigned char *line = out->scanlines.data() + y * scanline;
+        const unsigned char *row = image + (top + y) * stride + left;
+        line[0] = PNG_FILTER_VALUE_NONE;
+
+        if (!previous) {
+            memcpy(line + 1, row, width);
+            continue;
+        }
+
+        const unsigned char *prev = previous + (top + y) * stride + left;
+        for (size_t x = 0; x < width; ++x) {
+            unsigned char changed = row[x] ^ prev[x];
+            unsigned high = (changed & 0xf0) ? row[x] >> 4 : PIXEL_TRANSPARENT;
+            unsigned low = (changed & 0x0f) ? row[x] & 0x0f : PIXEL_TRANSPARENT;
+            line[x + 1] = (high << 4) | low;
+        }
+    }
+}
+
+// write data as chunks of the given type, each starting with the next
+// sequence number when sequence is given
+static void write_data(png_structp png, const char *type, const std::vector<unsigned char>& data,
+                       uint32_t *sequence) {
+    for (size_t offset = 0; offset < data.size(); offset += APNG_CHUNK_SIZE) {
+        size_t length = std::min<size_t>(APNG_CHUNK_SIZE, data.size() - offset);
+
+        unsigned char number[4];
+        png_write_chunk_start(png, (png_const_bytep)type, length + (sequence ? 4 : 0));
+        if (sequence) {
+            put_u32(number, (*sequence)++);
+            png_write_chunk_data(png, number, sizeof(number));
+        }
+        png_write_chunk_data(png, data.data() + offset, length);
+        png_write_chunk_end(png);
+    }
+}
+
+static void write_frame(png_structp png, const struct apng_frame& frame, uint32_t *sequence,
+                        uint16_t delay_num, uint16_t delay_den, bool first) {
+    unsigned char fctl[26];
+    put_u32(fctl, (*sequence)++);
+    put_u32(fctl + 4, frame.width);
+    put_u32(fctl + 8, frame.height);
+    put_u32(fctl + 12, frame.x);
+    put_u32(fctl + 16, frame.y);
+    put_u16(fctl + 20, delay_num);
+    put_u16(fctl + 22, delay_den);
+    fctl[24] = APNG_DISPOSE_OP_NONE;
+    fctl[25] = frame.blend_op;
+    png_write_chunk(png, (png_const_bytep)"fcTL", fctl, sizeof(fctl));
+
+    // the first frame doubles as the default image
+    if (first) {
+        write_data(png, "IDAT", frame.compressed, NULL);
+    } else {
+        write_data(png, "fdAT", frame.compressed, sequence);
+    }
+}
@@ -6,348 +6,576 @@
 
 #include <iostream>
 #include <fstream>
+#include <memory>
 #include <vector>
-#include <map>
+#include <algorithm>
+#include <utility>
 #include <string>
 #include <cstdlib>
 #include <cstdint>
+#include <cstring>
+#include <cerrno>
 #include <cassert>
+#include <charconv>
+#include <string_view>
 
 #include "./util.h"
+#include "./trace-iterator.h"
+#include "./range.h"
+#include "./page-states.h"
+#include "./state-planes.h"
+#include "./aggregate.h"
+#include "backends/parquet.h"
 #include "./smog-trace-converter.h"
 
-struct histogram_data {
-    size_t committed;
-    size_t accessed;
-    size_t dirty;
+// the number of pages formatted at once when writing the output
+#define HISTOGRAM_CHUNK_PAGES 65536
+
+// the longest line of the output, a 64 bit address in hex and three 64 bit
+// decimal counts with their separators
+#define HISTOGRAM_LINE_LENGTH (2 + 16 + 3 + 3 * 20 + 2 * 2 + 1)
+
+// on-disk layout of the binary histogram. the header is followed by the
+// names of the VMAs, each as a uint32_t length and its characters, padded
+// to 8 bytes, and then by a record per page at records_offset, so that the
+// records can be mapped as an array. all values are in host byte order.
+#define HISTOGRAM_MAGIC "SMOGHST"
+#define HISTOGRAM_VERSION 1
+
+struct histogram_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t page_size;
+    uint64_t num_names;
+    uint64_t num_records;
+    uint64_t records_offset;
 };
 
-class range {
- public:
-    size_t lower;
-    size_t upper;
+struct histogram_record {
+    uint64_t address;
+    uint32_t vma;  // position of the name in the name table
+    uint32_t committed;
+    uint32_t accessed;
+    uint32_t dirty;
+};
 
-    range(size_t start, size_t end) : lower(start), upper(end) {
-        // std::cout << "start: " << start << ", end: " << end << std::endl;
-        assert(upper >= lower);
-    }
+// the counters of all pages, each as an array of its own
+template<typename Counter>
+struct histogram_counters {
+    explicit histogram_counters(size_t pages)
+            : committed(pages), accessed(pages), dirty(pages) {}
 
-    bool intersects(range const& b) const {
-        return this->lower <= b.upper && b.lower <= this->upper;
-    }
+    std::vector<Counter> committed;
+    std::vector<Counter> accessed;
+    std::vector<Counter> dirty;
+};
 
-    bool operator==(range const& b) const {
-        return b.lower == lower && b.upper == upper;
-    }
+// the named VMAs, sorted by name, and where their pages are counted. every
+// per-name vector is indexed by the interned id of the name.
+struct histogram_layout {
+    std::vector<uint32_t> names;
+    std::vector<std::vector<range>> ranges;
+    std::vector<size_t> bases;
+    std::vector<range_index> indices;
+    size_t total_vmem;
+    size_t max_count;  // the most times any page can be counted
+};
 
-    bool operator!=(range const& b) const {
-        return b.lower != lower || b.upper != upper;
-    }
+// a piece of the output, either the header of a named VMA or the lines of
+// count pages of one of its ranges, starting at page
+struct output_chunk {
+    uint32_t id;
+    size_t page;
+    size_t offset;  // of the counters of the first page
+    size_t count;
+    bool header;
+};
 
-    bool operator>(range const& b) const {
-        return lower > b.upper;
+// format the line of a page as "0x<address> : <committed>; <accessed>; <dirty>"
+static inline char *format_line(char *out, size_t address, size_t committed, size_t accessed,
+                                size_t dirty) {
+    char *end = out + HISTOGRAM_LINE_LENGTH;
+
+    *out++ = '0';
+    *out++ = 'x';
+    out = std::to_chars(out, end, address, 16).ptr;
+    *out++ = ' ';
+    *out++ = ':';
+    *out++ = ' ';
+    out = std::to_chars(out, end, committed).ptr;
+    *out++ = ';';
+    *out++ = ' ';
+    out = std::to_chars(out, end, accessed).ptr;
+    *out++ = ';';
+    *out++ = ' ';
+    out = std::to_chars(out, end, dirty).ptr;
+    *out++ = '\n';
+
+    return out;
+}
+
+// cut the output into chunks of the pages of a range
+static std::vector<struct output_chunk> output_chunks(const struct histogram_layout& layout) {
+    std::vector<struct output_chunk> chunks;
+    for (uint32_t id : layout.names) {
+        size_t offset = layout.bases[id];
+
+        // every name starts with its header, even without any pages
+        chunks.push_back({ id, 0, 0, 0, true });
+
+        for (const range& r : layout.ranges[id]) {
+            for (size_t first = 0; first < r.num_pages(); first += HISTOGRAM_CHUNK_PAGES) {
+                size_t count = std::min(r.num_pages() - first, (size_t)HISTOGRAM_CHUNK_PAGES);
+                chunks.push_back({ id, r.lower + first, offset + first, count, false });
+            }
+            offset += r.num_pages();
+        }
     }
 
-    bool operator<(range const& b) const {
-        return upper < b.lower;
-    }
+    return chunks;
+}
+
+// format the chunks in parallel with format(chunk, std::vector<char> *buffer)
+// and write them to outfile in order
+template<typename Format>
+static int write_chunks(std::ofstream& outfile, const char *path,
+                        const std::vector<struct output_chunk>& chunks, Format format) {
+    #pragma omp parallel
+    {
+        std::vector<char> buffer;
 
-    range operator&(range b) {
-        size_t l = std::max(b.lower, lower);
-        size_t r = std::min(b.upper, upper);
-        if (r < l) {
-            return range(0, 0);
-        } else {
-            return range(l, r);
+        #pragma omp for ordered schedule(dynamic, 1)
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            format(chunks[i], &buffer);
+
+            #pragma omp ordered
+            outfile.write(buffer.data(), buffer.size());
         }
     }
 
-    range operator|(range b) {
-        size_t l = std::min(b.lower, lower);
-        size_t r = std::max(b.upper, upper);
-        return range(l, r);
+    if (!outfile.flush()) {
+        std::cerr << path << ": " << strerror(errno) << std::endl;
+        return 1;
     }
 
-    range& operator|=(range b) {
-        *this = *this | b;
-        return *this;
+    return 0;
+}
+
+// write the histogram as text, each named VMA as "VMA <name>" followed by
+// the line of each of its pages
+template<typename Counter>
+static int write_text(struct smog_tracefile *tracefile,
+                      const histogram_counters<Counter>& counters,
+                      const std::vector<struct output_chunk>& chunks, const char *path) {
+    std::ofstream outfile(path, std::ios::binary);
+    if (!outfile) {
+        std::cerr << path << ": " << strerror(errno) << std::endl;
+        return 1;
     }
 
-    friend std::ostream& operator<<(std::ostream &os, const range &r) {
-        os << std::hex << "(0x" << r.lower << ", 0x" << r.upper << ")" << std::dec;
-        return os;
+    return write_chunks(outfile, path, chunks,
+                        [&](const struct output_chunk& chunk, std::vector<char> *buffer) {
+        if (chunk.header) {
+            std::string_view name = trace_vma_name(tracefile, chunk.id);
+            buffer->assign(name.size() + 5, '\n');
+            memcpy(buffer->data(), "VMA ", 4);
+            memcpy(buffer->data() + 4, name.data(), name.size());
+            return;
+        }
+
+        buffer->resize(chunk.count * HISTOGRAM_LINE_LENGTH);
+        char *end = buffer->data();
+        for (size_t j = 0; j < chunk.count; ++j) {
+            size_t k = chunk.offset + j;
+            end = format_line(end, (chunk.page + j) * arguments.page_size,
+                              counters.committed[k], counters.accessed[k], counters.dirty[k]);
+        }
+        buffer->resize(end - buffer->data());
+    });
+}
+
+// write the histogram as a binary file of fixed size records
+template<typename Counter>
+static int write_binary(struct smog_tracefile *tracefile, const struct histogram_layout& layout,
+                        const histogram_counters<Counter>& counters,
+                        const std::vector<struct output_chunk>& chunks, const char *path) {
+    std::ofstream outfile(path, std::ios::binary);
+    if (!outfile) {
+        std::cerr << path << ": " << strerror(errno) << std::endl;
+        return 1;
     }
-};
 
-struct vma {
-    off_t index;
-    uint64_t lower;
-    uint64_t upper;
-    size_t num_pages;
-};
+    // the name table, with the position of each name in it
+    std::vector<char> names;
+    std::vector<uint32_t> name_index(tracefile->num_vma_names);
+    for (size_t i = 0; i < layout.names.size(); ++i) {
+        std::string_view name = trace_vma_name(tracefile, layout.names[i]);
+        uint32_t length = name.size();
 
-int backend_histogram(struct smog_tracefile *tracefile, const char *path) {
-    // aggregate address ranges
-    std::cout << "Aggregating VMA Ranges:   " << std::flush;
+        names.insert(names.end(), (const char*)&length, (const char*)&length + sizeof(length));
+        names.insert(names.end(), name.begin(), name.end());
+        name_index[layout.names[i]] = i;
+    }
+    names.resize((names.size() + 7) / 8 * 8);
+
+    struct histogram_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HISTOGRAM_MAGIC, sizeof(HISTOGRAM_MAGIC));
+    header.version = HISTOGRAM_VERSION;
+    header.record_size = sizeof(struct histogram_record);
+    header.page_size = arguments.page_size;
+    header.num_names = layout.names.size();
+    header.num_records = layout.total_vmem;
+    header.records_offset = sizeof(header) + names.size();
+
+    outfile.write((const char*)&header, sizeof(header));
+    outfile.write(names.data(), names.size());
+
+    return write_chunks(outfile, path, chunks,
+                        [&](const struct output_chunk& chunk, std::vector<char> *buffer) {
+        buffer->resize(chunk.count * sizeof(struct histogram_record));
+
+        struct histogram_record *records = (struct histogram_record*)buffer->data();
+        for (size_t j = 0; j < chunk.count; ++j) {
+            size_t k = chunk.offset + j;
+            records[j].address = (chunk.page + j) * arguments.page_size;
+            records[j].vma = name_index[chunk.id];
+            records[j].committed = counters.committed[k];
+            records[j].accessed = counters.accessed[k];
+            records[j].dirty = counters.dirty[k];
+        }
+    });
+}
+
+// write the histogram as a parquet table
+template<typename Counter>
+static int write_parquet(struct smog_tracefile *tracefile, const struct histogram_layout& layout,
+                         const histogram_counters<Counter>& counters,
+                         const std::vector<struct output_chunk>& chunks, const char *path) {
+    histogram_table table;
+    if (table.open(path) != 0) {
+        return 1;
+    }
 
-    std::map<std::string, std::vector<range>> ranges;
+    std::vector<std::string> names(tracefile->num_vma_names);
+    for (uint32_t id : layout.names) {
+        names[id] = std::string(trace_vma_name(tracefile, id));
+    }
 
-    for (size_t i = 0; i < tracefile->num_frames; ++i) {
-        off_t index = tracefile->frame_offsets[i];
+    for (const struct output_chunk& chunk : chunks) {
+        for (size_t j = 0; j < chunk.count; ++j) {
+            size_t k = chunk.offset + j;
+            table.write(names[chunk.id], (chunk.page + j) * arguments.page_size,
+                        counters.committed[k], counters.accessed[k], counters.dirty[k]);
+        }
+    }
 
-        // advance the index over the frame
-        // skip timestamp
-        index += 8;
+    return table.close();
+}
+
+// count the states of a block of pages into the counters starting at page.
+// the counters of a page are independent, so the loop is vectorized.
+template<typename Counter>
+static inline void count_block(const uint8_t *__restrict states, size_t count,
+                               histogram_counters<Counter> *counters, size_t page) {
+    Counter *__restrict committed = counters->committed.data() + page;
+    Counter *__restrict accessed = counters->accessed.data() + page;
+    Counter *__restrict dirty = counters->dirty.data() + page;
+
+    #pragma omp simd
+    for (size_t j = 0; j < count; ++j) {
+        // reserved and not present: 0
+        // present and not accessed: 1
+        // accessed and not dirty:   2
+        // dirty:                    3
+        committed[j] += states[j] > 0;
+        accessed[j] += states[j] > 1;
+        dirty[j] += states[j] > 2;
+    }
+}
+
+// add the counters of from to into
+template<typename Counter>
+static void merge_counters(histogram_counters<Counter> *into,
+                           const histogram_counters<Counter>& from) {
+    Counter *__restrict committed = into->committed.data();
+    Counter *__restrict accessed = into->accessed.data();
+    Counter *__restrict dirty = into->dirty.data();
+
+    #pragma omp simd
+    for (size_t j = 0; j < from.committed.size(); ++j) {
+        committed[j] += from.committed[j];
+        accessed[j] += from.accessed[j];
+        dirty[j] += from.dirty[j];
+    }
+}
+
+// every thread counts its share of the frames into counters of its own,
+// which are added up pairwise at the end. so the trace is read once,
+// whatever the number of threads. create() makes the counters of a thread,
+// count(T *local, vma, offset) adds a VMA whose pages start at offset and
+// merge(T *into, const T& from) adds up two of them.
+template<typename T, typename Create, typename Count, typename Merge>
+static std::unique_ptr<T> count_frames(struct smog_tracefile *tracefile,
+                                       const struct histogram_layout& layout, Create create,
+                                       Count count, Merge merge) {
+    typedef std::unique_ptr<T> partial_counts;
+
+    return aggregate_frames<partial_counts>(tracefile->num_frames,
+        [&](partial_counts& local, size_t i) {
+            if (!local) {
+                local.reset(create());
+            }
 
-        // get number of VMAs
-        uint32_t num_vmas = *(uint32_t*)(tracefile->buffer + index);
-        index += 4;
+            for (const trace_vma& vma : trace_frame(tracefile, i)) {
+                if (!vma.named || vma.end <= vma.start) {
+                    continue;
+                }
 
-        // extend the list of ranges by each named VMA
-        for (uint32_t i = 0; i < num_vmas; ++i) {
-            // get VMA start / end
-            uint64_t vma_start = *(uint64_t*)(tracefile->buffer + index);
-            uint64_t vma_end = *(uint64_t*)(tracefile->buffer + index + 8);
-            index += 16;
+                count(local.get(), vma,
+                      layout.bases[vma.id] + layout.indices[vma.id].offset(vma.start));
+            }
+        },
+        [&](partial_counts& into, partial_counts& from) {
+            if (!into) {
+                into.swap(from);
+            } else if (from) {
+                merge(into.get(), *from);
+                from.reset();
+            }
+        });
+}
+
+// accumulate the counters of all frames and write them out
+template<typename Counter>
+static int histogram_pass(struct smog_tracefile *tracefile, const struct histogram_layout& layout,
+                          const char *path) {
+    std::unique_ptr<histogram_counters<Counter>> counters;
+
+    if (state_planes::accelerated()) {
+        // count straight from the packed words into bit-sliced counters
+        std::unique_ptr<state_planes> planes = count_frames<state_planes>(tracefile, layout,
+            [&]() {
+                return new state_planes(layout.total_vmem, layout.max_count);
+            },
+            [](state_planes *local, const trace_vma& vma, size_t offset) {
+                local->add(vma.words, 0, vma.num_pages(), offset);
+            },
+            [](state_planes *into, const state_planes& from) {
+                into->merge(from);
+            });
+
+        counters.reset(new histogram_counters<Counter>(layout.total_vmem));
+        if (planes) {
+            planes->expand(counters->committed.data(), counters->accessed.data(),
+                           counters->dirty.data());
+        }
+    } else {
+        counters = count_frames<histogram_counters<Counter>>(tracefile, layout,
+            [&]() {
+                return new histogram_counters<Counter>(layout.total_vmem);
+            },
+            [](histogram_counters<Counter> *local, const trace_vma& vma, size_t offset) {
+                // calculate histogram data
+                for_each_state_block(vma, [&](size_t first, const uint8_t *states,
+                                              size_t count) {
+                    count_block(states, count, local, offset + first);
+                });
+            },
+            merge_counters<Counter>);
+
+        if (!counters) {
+            counters.reset(new histogram_counters<Counter>(layout.total_vmem));
+        }
+    }
 
-            // get VMA name
-            uint32_t length = *(uint32_t*)(tracefile->buffer + index);
-            index += 4;
+    std::vector<struct output_chunk> chunks = output_chunks(layout);
 
-            if (!length) {
-                continue;
-            }
+    switch (arguments.output_format) {
+        case OUTPUT_HISTOGRAM_BINARY:
+            return write_binary(tracefile, layout, *counters, chunks, path);
+        case OUTPUT_HISTOGRAM_PARQUET:
+            return write_parquet(tracefile, layout, *counters, chunks, path);
+        default:
+            return write_text(tracefile, *counters, chunks, path);
+    }
+}
+
+// the most VMAs of the same name covering any one page of a frame, which is
+// how often the frame can count a page
+static size_t frame_overlap(const trace_frame& frame) {
+    // the starts and ends of the named VMAs, ends sorting first at the same
+    // page as they are exclusive
+    struct bound {
+        uint32_t id;
+        uint64_t page;
+        int delta;
+
+        bool operator<(const bound& b) const {
+            return id != b.id ? id < b.id : page != b.page ? page < b.page : delta < b.delta;
+        }
+    };
 
-            std::string name(tracefile->buffer + index, length - 1);
-            index += length;
+    std::vector<struct bound> bounds;
+    for (const trace_vma& vma : frame) {
+        if (vma.named && vma.end > vma.start) {
+            bounds.push_back({ vma.id, vma.start, 1 });
+            bounds.push_back({ vma.id, vma.end, -1 });
+        }
+    }
+    std::sort(bounds.begin(), bounds.end());
 
-            if (ranges.find(name) == ranges.end()) {
-                ranges[name] = std::vector<range>();
-            }
+    size_t depth = 0, max_depth = 0;
+    for (const struct bound& b : bounds) {
+        depth += b.delta;
+        max_depth = std::max(max_depth, depth);
+    }
 
-            size_t pages = vma_end - vma_start;
+    return max_depth;
+}
 
-            // insert VMA into active ranges
-            struct range vma = { vma_start, vma_end - 1 };
-            if (arguments.verbose > 3) {
-                std::cout << "considering VMA '" << name << "' with range " << vma << std::endl;
-            }
+int backend_histogram(struct smog_tracefile *tracefile, const char *path) {
+    // aggregate address ranges
+    std::cout << "Aggregating VMA Ranges:   " << std::flush;
 
-            if (vma.lower == 0 && vma.upper == (size_t)-1) {
-                continue;
+    // the VMA names are interned into dense ids by the index, every
+    // per-name structure is a vector indexed by the id
+    size_t num_names = tracefile->num_vma_names;
+
+    // the sets of ranges of each name, and whether any VMA was named. an
+    // empty name is interned like the missing name of unnamed VMAs, but
+    // only VMAs storing a name, even an empty one, get a section.
+    struct named_range_sets {
+        std::vector<range_set> sets;
+        std::vector<char> named;
+        size_t max_count = 0;
+    };
+
+    named_range_sets aggregate = aggregate_frames<named_range_sets>(tracefile->num_frames,
+        [&](named_range_sets& local, size_t i) {
+            if (local.sets.empty()) {
+                local.sets.resize(num_names);
+                local.named.resize(num_names);
             }
 
-            int matched = 0;
-            for (size_t j = 0; j < ranges[name].size(); ++j) {
-                if (vma.lower > ranges[name][j].upper) {
-                    // keep going
+            // VMAs are listed in ascending order, VMAs of the same name
+            // overlapping count their pages more than once per frame
+            bool disjoint = true;
+            uint64_t last_end = 0;
+
+            // extend the sets of ranges by each named VMA
+            for (const trace_vma& vma : trace_frame(tracefile, i)) {
+                if (!vma.named) {
                     continue;
                 }
+                local.named[vma.id] = 1;
 
-                if (ranges[name][j].intersects(vma)) {
-                    // overlapping, extend match
-                    if (arguments.verbose > 3) {
-                        std::cout << "  extending " << ranges[name][j];
-                    }
-                    ranges[name][j] |= vma;
-                    if (arguments.verbose > 3) {
-                        std::cout << " -> " << ranges[name][j] << std::endl;
-                    }
-                    matched++;
+                // skip empty VMAs
+                if (vma.end <= vma.start) {
                     continue;
                 }
 
-                if (vma.upper < ranges[name][j].lower) {
-                    // beyond. insert if not matched yet
-                    if (!matched) {
-                        if (arguments.verbose > 3) {
-                            std::cout << "  inserting at " << j << std::endl;
-                        }
-                        ranges[name].insert(ranges[name].begin() + j, vma);
-                        matched++;
-                    }
-                    break;
-                }
-            }
-            if (!matched) {
-                // completely new, append.
+                disjoint = disjoint && vma.start >= last_end;
+                last_end = vma.end;
+
+                range range(vma.start, vma.end - 1);
                 if (arguments.verbose > 3) {
-                    std::cout << "  appending at " << ranges[name].size() << std::endl;
+                    std::cout << "considering VMA '" << vma.name << "' with range " << range
+                              << std::endl;
                 }
-                //std::cout << ranges[name].size() << std::endl;
-                fflush(stdout);
-                ranges[name].push_back(vma);
-            }
 
-            // merge adjancent or overlapping ranges
-            for (size_t j = 1; j < ranges[name].size(); ++j) {
-                if (ranges[name][j - 1].intersects(ranges[name][j])
-                        || ranges[name][j - 1].upper == ranges[name][j].lower - 1) {
-                    if (arguments.verbose > 3) {
-                        std::cout << "  merging " << ranges[name][j - 1] << ", " << ranges[name][j];
-                    }
-                    ranges[name][j - 1] |= ranges[name][j];
-                    if (arguments.verbose > 3) {
-                        std::cout << "-> " << ranges[name][j - 1] << std::endl;
-                    }
-                    ranges[name].erase(ranges[name].begin() + j);
-                    j--;
-                }
+                local.sets[vma.id].insert(range);
             }
 
-            if (arguments.verbose > 3) {
-                std::cout << ranges[name].size() << " ranges" << std::endl;
-                if (arguments.verbose) {
-                    for (size_t i = 0; i < ranges[name].size(); ++i) {
-                        size_t num_pages = ranges[name][i].upper - ranges[name][i].lower + 1;
-                        std::cout << "  " << ranges[name][i] << " :: " << num_pages << " Pages, "
-                                  << format_size_string(num_pages * arguments.page_size)
-                                  << std::endl;
-                    }
-                }
+            local.max_count += disjoint ? 1 : frame_overlap(trace_frame(tracefile, i));
+        },
+        [](named_range_sets& into, named_range_sets& from) {
+            if (into.sets.empty()) {
+                std::swap(into, from);
+                return;
             }
-
-            // advance the index over the pages
-            size_t words = (pages * 2 + (32 - 1)) / 32;
-            index += words * 4;
+            for (size_t id = 0; id < from.sets.size(); ++id) {
+                into.sets[id].merge(from.sets[id]);
+                into.named[id] |= from.named[id];
+            }
+            into.max_count += from.max_count;
+        });
+    aggregate.sets.resize(num_names);
+    aggregate.named.resize(num_names);
+
+    // the named VMAs, in the order of their names
+    std::vector<uint32_t> names;
+    for (uint32_t id = 0; id < num_names; ++id) {
+        if (aggregate.named[id]) {
+            names.push_back(id);
         }
     }
+    std::sort(names.begin(), names.end(), [&](uint32_t a, uint32_t b) {
+        return trace_vma_name(tracefile, a) < trace_vma_name(tracefile, b);
+    });
 
+    std::vector<std::vector<range>> ranges(num_names);
+    for (uint32_t id : names) {
+        ranges[id] = aggregate.sets[id].ranges();
+    }
+
+    // the counters of all named VMAs are laid out one after the other
     size_t total_vmem = 0;
-    std::map<std::string, size_t> named_vmem;
+    std::vector<size_t> bases(num_names);
     size_t num_ranges = 0;
-    for (const auto& named : ranges) {
-        num_ranges += named.second.size();
-        size_t vmem = 0;
-        for (size_t i = 0; i < named.second.size(); ++i) {
-            vmem += named.second[i].upper - named.second[i].lower + 1;
+    for (uint32_t id : names) {
+        num_ranges += ranges[id].size();
+        bases[id] = total_vmem;
+        for (size_t i = 0; i < ranges[id].size(); ++i) {
+            total_vmem += ranges[id][i].upper - ranges[id][i].lower + 1;
         }
-        named_vmem[named.first] = vmem;
-        total_vmem += vmem;
     }
 
-    std::cout << "found " << ranges.size() << " named VMAs with " << num_ranges << " ranges and " << total_vmem << " pages, sized "
+    std::cout << "found " << names.size() << " named VMAs with " << num_ranges << " ranges and " << total_vmem << " pages, sized "
               << format_size_string(total_vmem * arguments.page_size) << std::endl;
     if (arguments.verbose) {
-        for (const auto& named : ranges) {
-            std::cout << "  " << named.first.c_str() << std::endl;
-            for (size_t i = 0; i < named.second.size(); ++i) {
-                size_t num_pages = named.second[i].upper - named.second[i].lower + 1;
-                std::cout << "    " << named.second[i] << " :: " << num_pages << " Pages, "
+        for (uint32_t id : names) {
+            std::cout << "  " << trace_vma_name(tracefile, id) << std::endl;
+            for (size_t i = 0; i < ranges[id].size(); ++i) {
+                size_t num_pages = ranges[id][i].upper - ranges[id][i].lower + 1;
+                std::cout << "    " << ranges[id][i] << " :: " << num_pages << " Pages, "
                         << format_size_string(num_pages * arguments.page_size)
                         << std::endl;
             }
         }
     }
 
-    std::map<std::string, std::vector<struct histogram_data>> histogram;
-    for (const auto& named : named_vmem) {
-        histogram[named.first] = std::vector<struct histogram_data>(named.second);
+    std::vector<range_index> indices;
+    indices.reserve(num_names);
+    for (uint32_t id = 0; id < num_names; ++id) {
+        indices.emplace_back(ranges[id]);
     }
 
-    for (size_t i = 0; i < tracefile->num_frames; ++i) {
-        //write_frame(path, ranges, total_vmem, tracefile->buffer + tracefile->frame_offsets[i]);
-        char *buffer = tracefile->buffer + tracefile->frame_offsets[i];
-        off_t index = 0;
-
-        // advance over timestamp data
-        index += 8;
-
-         // extract the number of VMAs from the frame
-        uint32_t num_vmas = *(uint32_t*)(buffer + index);
-        index += 4;
-
-        // index all vma offsets from the frame
-        std::vector<struct vma> vmas(num_vmas);
-
-        for (size_t i = 0; i < num_vmas; ++i) {
-            vmas[i].index = index;
-
-            // get vma start and end
-            uint64_t start = *(uint64_t*)(buffer + index);
-            uint64_t end = *(uint64_t*)(buffer + index + 8);
-            index += 16;
-
-            size_t pages = end - start;
-
-            vmas[i].lower = start;
-            vmas[i].upper = end;
-
-            vmas[i].num_pages = pages;
-
-            // get the name
-            uint32_t length = *(uint32_t*)(buffer + index);
-            index += 4;
-
-            if (!length) {
-                continue;
-            }
-
-            std::string name(buffer + index, length - 1);
-            index += length;
-
-            size_t offset = 0;
-            for (size_t j = 0; j < ranges[name].size(); ++j) {
-                if (start > ranges[name][j].upper) {
-                    offset += ranges[name][j].upper - ranges[name][j].lower + 1;
-                } else if (start > ranges[name][j].lower) {
-                    offset += start - ranges[name][j].lower;
-                } else {
-                    break;
-                }
-            }
-
-            // calculate the words encoding the page bits
-            size_t words = (pages * 2 + (32 - 1)) / 32;
-            uint32_t *page_buffer = (uint32_t*)(buffer + index);
-
-            // calculate histogram data
-            for (size_t j = 0; j < pages; ++j) {
-                int value = (page_buffer[j / 16] >> ((j % 16) * 2)) & 0x3;
-
-                size_t pos = offset + j;
-
-                // not reserved: black            (0, 0, 0)
-                // reserved and not present: blue (0, 0, 1)
-                // present and not accessed: cyan (0, 1, 1)
-                // accessed and not dirty: green  (0, 1, 0)
-                // dirty: red                     (1, 0, 0)
-
-                if (value > 0)
-                    histogram[name][pos].committed += 1;
-                if (value > 1)
-                    histogram[name][pos].accessed += 1;
-                if (value > 2)
-                    histogram[name][pos].dirty += 1;
-            }
-
-            index += words * 4;
-        }
+    // no page is counted more often than the most overlapping VMAs of each
+    // frame add up to, once per frame unless VMAs of the same name overlap.
+    // so the narrowest counters holding that can never overflow.
+    size_t max_count = aggregate.max_count;
+    if (max_count > tracefile->num_frames) {
+        std::cerr << "warning: overlapping VMAs of the same name count pages up to "
+                  << max_count << " times" << std::endl;
     }
 
-    std::ofstream outfile(path);
-
-    for (const auto& named: ranges) {
-        outfile << "VMA " << named.first << std::endl;
-
-        size_t offset = 0;
-
-        for (size_t i = 0; i < named.second.size(); ++i) {
-            size_t num_pages = named.second[i].upper - named.second[i].lower;
-
-            uintptr_t base = named.second[i].lower;
-
-            for (size_t j = 0; j < num_pages; ++j) {
-                outfile << std::hex << "0x" << (base + j) * arguments.page_size << std::dec << " : " 
-                        << histogram[named.first][offset + j].committed << "; "
-                        << histogram[named.first][offset + j].accessed << "; "
-                        << histogram[named.first][offset + j].dirty << std::endl;
-            }            
-
-            offset += num_pages;
-        }
+    struct histogram_layout layout = { std::move(names), std::move(ranges), std::move(bases),
+                                       std::move(indices), total_vmem, max_count };
 
+    if (arguments.output_format != OUTPUT_HISTOGRAM && max_count > UINT32_MAX) {
+        std::cerr << "error: the binary and parquet histograms count a page at most "
+                  << UINT32_MAX << " times" << std::endl;
+        return 1;
     }
 
-    return 0;
-}
\ No newline at end of file
+    if (max_count <= UINT8_MAX) {
+        return histogram_pass<uint8_t>(tracefile, layout, path);
+    } else if (max_count <= UINT16_MAX) {
+        return histogram_pass<uint16_t>(tracefile, layout, path);
+    } else if (max_count <= UINT32_MAX) {
+        return histogram_pass<uint32_t>(tracefile, layout, path);
+    }
+    return histogram_pass<uint64_t>(tracefile, layout, path);
+}
@@ -10,7 +10,15 @@
 #include <parquet/stream_writer.h>
 
 #include <memory>
+#include <exception>
 #include <iostream>
+#include <string>
+#include <vector>
+
+#include "./trace-iterator.h"
+#include "./page-states.h"
+#include "./frame-output.h"
+#include "./smog-trace-converter.h"
 
 using parquet::WriterProperties;
 using parquet::ParquetVersion;
@@ -18,7 +26,7 @@ using parquet::ParquetDataPageVersion;
 using arrow::Compression;
 
 static void write_frame(const char *outfile, std::shared_ptr<parquet::schema::GroupNode> schema,
-                        char *buffer);
+                        trace_frame frame);
 
 int backend_parquet(struct smog_tracefile *tracefile, const char *path) {
     // check the outfile pattern
@@ -43,6 +51,18 @@ int backend_parquet(struct smog_tracefile *tracefile, const char *path) {
     auto schema = std::static_pointer_cast<parquet::schema::GroupNode>(
         parquet::schema::GroupNode::Make("schema", parquet::Repetition::REQUIRED, fields));
 
+    // frames repeating an earlier frame share its output
+    std::vector<size_t> original;
+    if (arguments.dedup != DEDUP_NONE) {
+        original = find_duplicate_frames(tracefile);
+
+        size_t duplicates = 0;
+        for (size_t i = 0; i < original.size(); ++i) {
+            duplicates += original[i] != i;
+        }
+        std::cout << "Found " << duplicates << " duplicate frames" << std::endl;
+    }
+
     std::cout << "Unpacking parquet files:  0%" << std::flush;
 
     size_t total_work = tracefile->num_frames;
@@ -50,7 +70,11 @@ int backend_parquet(struct smog_tracefile *tracefile, const char *path) {
 
     #pragma omp parallel for
     for (size_t i = 0; i < tracefile->num_frames; ++i) {
-        write_frame(path, schema, tracefile->buffer + tracefile->frame_offsets[i]);
+        if (original.empty() || original[i] == i) {
+            write_frame(path, schema, trace_frame(tracefile, i));
+        } else if (arguments.dedup == DEDUP_LINK) {
+            link_frame_output(path, tracefile, i, original[i]);
+        }
 
         // progress reporting on the last thread
         if (omp_get_thread_num() == omp_get_num_threads() - 1) {
@@ -68,31 +92,12 @@ int backend_parquet(struct smog_tracefile *tracefile, const char *path) {
 }
 
 static void write_frame(const char *outfile, std::shared_ptr<parquet::schema::GroupNode> schema,
-                        char *buffer) {
-    // extract the timeval from the frame
-    time_t sec = *(uint32_t*)buffer;
-    uint32_t usec = *(uint32_t*)(buffer + 4);
-
-    struct tm tm;
-    localtime_r(&sec, &tm);
-
-    // produce a string representation of the time
-    char timestr[27];
-    size_t len = strftime(timestr, 20, "%F_%T", &tm);
-    if (len == 0 || len >= 20) {
-        std::cerr << "failed to create output filename" << std::endl;
-        return;
-    }
-    snprintf(timestr + len, 8, ".%06u", usec);
-
+                        trace_frame frame) {
     // produce a path to the output file
-    int n = snprintf(NULL, 0, outfile, timestr);
-    char *outfile_buf = (char*)malloc(n);
-    if (outfile_buf == NULL) {
-        std::cerr << "failed to allocate memory" << std::endl;
+    std::string outfile_buf;
+    if (frame_output_path(outfile, frame, &outfile_buf) != 0) {
         return;
     }
-    snprintf(outfile_buf, n + 1, outfile, timestr);
 
     // open the output stream
     std::shared_ptr<arrow::io::FileOutputStream> outstream;
@@ -114,33 +119,93 @@ static void write_frame(const char *outfile, std::shared_ptr<parquet::schema::Gr
         parquet::ParquetFileWriter::Open(outstream, schema, builder.build())
     };
 
-    // extract the number of VMAs from the frame
-    uint32_t num_vmas = *(uint32_t*)(buffer + 8);
+    for (const trace_vma& vma : frame) {
+        for_each_state_block(vma, [&](size_t first, const uint8_t *states, size_t count) {
+            for (size_t j = 0; j < count; ++j) {
+                bool is_present = states[j] & 0x1;
+                bool is_dirty   = (states[j] >> 1) & 0x1;
+                uint64_t pageno = vma.start + first + j;
 
-    size_t index = 12;
-    for (size_t i = 0; i < num_vmas; ++i) {
-        uint64_t start = *(uint64_t*)(buffer + index);
-        uint64_t end = *(uint64_t*)(buffer + index + 8);
-        index += 16;
+                out << pageno << is_present << is_dirty << parquet::EndRow;
+            }
+        });
+    }
+}
 
-        size_t pages = end - start;
+struct histogram_table::writer {
+    std::shared_ptr<arrow::io::FileOutputStream> file;
+    std::unique_ptr<parquet::StreamWriter> stream;
+};
 
-        uint32_t length = *(uint32_t*)(buffer + index);
-        index += 4 + length;
+histogram_table::histogram_table() {}
 
-        size_t words = (pages * 2 + (32 - 1)) / 32;
+histogram_table::~histogram_table() {}
 
-        for (size_t j = 0; j < pages; ++j) {
-            bool is_present = (buffer[j / 16] >> ((j % 16) * 2)) & 0x1;
-            bool is_dirty   = (buffer[j / 16] >> ((j % 16) * 2 + 1)) & 0x1;
-            uint64_t pageno = start + j;
+int histogram_table::open(const char *path) {
+    parquet::schema::NodeVector fields;
 
-            out << pageno << is_present << is_dirty << parquet::EndRow;
-        }
+    fields.push_back(parquet::schema::PrimitiveNode::Make(
+        "vma", parquet::Repetition::REQUIRED, parquet::Type::BYTE_ARRAY,
+        parquet::ConvertedType::UTF8));
+    fields.push_back(parquet::schema::PrimitiveNode::Make(
+        "address", parquet::Repetition::REQUIRED, parquet::Type::INT64,
+        parquet::ConvertedType::UINT_64));
+    fields.push_back(parquet::schema::PrimitiveNode::Make(
+        "committed", parquet::Repetition::REQUIRED, parquet::Type::INT32,
+        parquet::ConvertedType::UINT_32));
+    fields.push_back(parquet::schema::PrimitiveNode::Make(
+        "accessed", parquet::Repetition::REQUIRED, parquet::Type::INT32,
+        parquet::ConvertedType::UINT_32));
+    fields.push_back(parquet::schema::PrimitiveNode::Make(
+        "dirty", parquet::Repetition::REQUIRED, parquet::Type::INT32,
+        parquet::ConvertedType::UINT_32));
+
+    auto schema = std::static_pointer_cast<parquet::schema::GroupNode>(
+        parquet::schema::GroupNode::Make("schema", parquet::Repetition::REQUIRED, fields));
+
+    out.reset(new writer);
+
+    try {
+        PARQUET_ASSIGN_OR_THROW(
+            out->file,
+            arrow::io::FileOutputStream::Open(path));
+
+        // the few VMA names repeat in every row, so they are dictionary encoded
+        parquet::WriterProperties::Builder builder;
+        builder
+           .max_row_group_length(1024 * 1024)
+           ->created_by("smog-meter")
+           ->version(ParquetVersion::PARQUET_2_6)
+           ->data_page_version(ParquetDataPageVersion::V2)
+           ->enable_dictionary("vma")
+           ->compression(Compression::SNAPPY);
+
+        out->stream.reset(new parquet::StreamWriter {
+            parquet::ParquetFileWriter::Open(out->file, schema, builder.build())
+        });
+    } catch (const std::exception& e) {
+        std::cerr << path << ": " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
 
-        index += words * 4;
+void histogram_table::write(const std::string& vma, uint64_t address, uint32_t committed,
+                            uint32_t accessed, uint32_t dirty) {
+    *out->stream << vma << address << committed << accessed << dirty << parquet::EndRow;
+}
+
+int histogram_table::close() {
+    try {
+        // destroying the stream writer writes the footer of the file
+        out->stream.reset();
+        PARQUET_THROW_NOT_OK(out->file->Close());
+        out.reset();
+    } catch (const std::exception& e) {
+        std::cerr << "parquet: " << e.what() << std::endl;
+        return 1;
     }
 
-    // cleanup
-    free(outfile_buf);
+    return 0;
 }
@@ -15,6 +15,30 @@ int backend_parquet(struct smog_tracefile *tracefile, const char *path);
 
 #ifdef __cplusplus
 }
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// a parquet table of the histogram, with a row per page holding the VMA
+// name, the page address and the committed, accessed and dirty counts
+class histogram_table {
+ public:
+    histogram_table();
+    ~histogram_table();
+
+    int open(const char *path);
+
+    void write(const std::string& vma, uint64_t address, uint32_t committed, uint32_t accessed,
+               uint32_t dirty);
+
+    int close();
+
+ private:
+    struct writer;
+    std::unique_ptr<writer> out;
+};
+
 #endif  // __cplusplus
 
 #endif  // BACKENDS_PARQUET_H_
@@ -5,78 +5,44 @@
 #include "backends/png-frames.h"
 
 #include <iostream>
+#include <memory>
+#include <string>
 #include <vector>
+#include <algorithm>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
-#include <cmath>
+#include <cerrno>
 #include <cassert>
 
 #include <png.h>
 #include <omp.h>
 
 #include "./util.h"
+#include "./trace-iterator.h"
+#include "./pixels.h"
+#include "./range.h"
+#include "./layout.h"
+#include "./render.h"
+#include "./deflate.h"
+#include "./frame-output.h"
 #include "./smog-trace-converter.h"
 
-class range {
- public:
-    size_t lower;
-    size_t upper;
+// the state each thread keeps across the frames it writes, so that the
+// buffers and the compressor are set up once per thread instead of once per
+// frame
+struct frame_context {
+    // the image as png scanlines, each starting with its filter type
+    std::vector<unsigned char> scanlines;
+    std::vector<unsigned char> compressed;
+    std::string filename;
 
-    range(size_t start, size_t end) : lower(start), upper(end) {
-        // std::cout << "start: " << start << ", end: " << end << std::endl;
-        assert(upper >= lower);
-    }
-
-    bool intersects(range const& b) const {
-        return this->lower <= b.upper && b.lower <= this->upper;
-    }
-
-    bool operator==(range const& b) const {
-        return b.lower == lower && b.upper == upper;
-    }
-
-    bool operator!=(range const& b) const {
-        return b.lower != lower || b.upper != upper;
-    }
-
-    bool operator>(range const& b) const {
-        return lower > b.upper;
-    }
-
-    bool operator<(range const& b) const {
-        return upper < b.lower;
-    }
-
-    range operator&(range b) {
-        size_t l = std::max(b.lower, lower);
-        size_t r = std::min(b.upper, upper);
-        if (r < l) {
-            return range(0, 0);
-        } else {
-            return range(l, r);
-        }
-    }
-
-    range operator|(range b) {
-        size_t l = std::min(b.lower, lower);
-        size_t r = std::max(b.upper, upper);
-        return range(l, r);
-    }
-
-    range& operator|=(range b) {
-        *this = *this | b;
-        return *this;
-    }
-
-    friend std::ostream& operator<<(std::ostream &os, const range &r) {
-        os << std::hex << "(0x" << r.lower << ", 0x" << r.upper << ")" << std::dec;
-        return os;
-    }
+    deflate_stream deflate;
 };
 
-static void write_frame(const char *outfile, std::vector<range> ranges,
-                        size_t total_vmem, char *buffer);
+static void write_frame(struct frame_context *context, const char *outfile,
+                        const range_index& index, const page_layout& layout,
+                        trace_frame frame);
 
 int backend_png_frames(struct smog_tracefile *tracefile, const char *path) {
     // check the outfile pattern
@@ -88,147 +54,71 @@ int backend_png_frames(struct smog_tracefile *tracefile, const char *path) {
     // aggregate address ranges
     std::cout <<"Aggregating VMA Ranges:   " << std::flush;
 
-    std::vector<range> ranges;
-
-    for (size_t i = 0; i < tracefile->num_frames; ++i) {
-        off_t index = tracefile->frame_offsets[i];
-
-        // advance the index over the frame
-        // skip timestamp
-        index += 8;
-
-        // get number of VMAs
-        uint32_t num_vmas = *(uint32_t*)(tracefile->buffer + index);
-        index += 4;
-
-        // extend the list of ranges by each VMA
-        for (uint32_t i = 0; i < num_vmas; ++i) {
-            // get VMA start / end
-            uint64_t vma_start = *(uint64_t*)(tracefile->buffer + index);
-            uint64_t vma_end = *(uint64_t*)(tracefile->buffer + index + 8);
-            index += 16;
+    range_set aggregate = aggregate_vma_ranges(tracefile);
 
-            size_t pages = vma_end - vma_start;
-
-            // insert VMA into active ranges
-            struct range vma = { vma_start, vma_end - 1 };
-            if (arguments.verbose > 3) {
-                std::cout << "considering range " << vma << std::endl;
-            }
-
-            if (vma.lower == 0 && vma.upper == (size_t)-1) {
-                continue;
-            }
-
-            int matched = 0;
-            for (size_t j = 0; j < ranges.size(); ++j) {
-                if (vma.lower > ranges[j].upper) {
-                    // keep going
-                    continue;
-                }
-
-                if (ranges[j].intersects(vma)) {
-                    // overlapping, extend match
-                    if (arguments.verbose > 3) {
-                        std::cout << "  extending " << ranges[j];
-                    }
-                    ranges[j] |= vma;
-                    if (arguments.verbose > 3) {
-                        std::cout << "-> " << ranges[j] << std::endl;
-                    }
-                    matched++;
-                    continue;
-                }
-
-                if (vma.upper < ranges[j].lower) {
-                    // beyond. insert if not matched yet
-                    if (!matched) {
-                        if (arguments.verbose > 3) {
-                            std::cout << "  inserting at " << j << std::endl;
-                        }
-                        ranges.insert(ranges.begin() + j, vma);
-                        matched++;
-                    }
-                    break;
-                }
-            }
-            if (!matched) {
-                // completely new, append.
-                if (arguments.verbose > 3) {
-                    std::cout << "  appending at " << ranges.size() << std::endl;
-                }
-                ranges.push_back(vma);
-            }
-
-            // merge adjancent or overlapping ranges
-            for (size_t j = 1; j < ranges.size(); ++j) {
-                if (ranges[j - 1].intersects(ranges[j])
-                        || ranges[j - 1].upper == ranges[j].lower - 1) {
-                    if (arguments.verbose > 3) {
-                        std::cout << "  merging " << ranges[j - 1] << ", " << ranges[j];
-                    }
-                    ranges[j - 1] |= ranges[j];
-                    if (arguments.verbose > 3) {
-                        std::cout << "-> " << ranges[j - 1] << std::endl;
-                    }
-                    ranges.erase(ranges.begin() + j);
-                    j--;
-                }
-            }
-
-            if (arguments.verbose > 3) {
-                std::cout << ranges.size() << " ranges" << std::endl;
-                if (arguments.verbose) {
-                    for (size_t i = 0; i < ranges.size(); ++i) {
-                        size_t num_pages = ranges[i].upper - ranges[i].lower + 1;
-                        std::cout << "  " << ranges[i] << " :: " << num_pages << " Pages, "
-                                  << format_size_string(num_pages * arguments.page_size)
-                                  << std::endl;
-                    }
-                }
-            }
-
-            // skip over the name
-            uint32_t length = *(uint32_t*)(tracefile->buffer + index);
-            index += 4 + length;
-
-            // advance the index over the pages
-            size_t words = (pages * 2 + (32 - 1)) / 32;
-            index += words * 4;
-        }
-    }
-
-    size_t total_vmem = 0;
-    for (size_t i = 0; i < ranges.size(); ++i) {
-        total_vmem += ranges[i].upper - ranges[i].lower + 1;
-    }
+    std::vector<range> ranges = aggregate.ranges();
+    size_t total_vmem = aggregate.num_pages();
 
     std::cout << "found " << ranges.size() << " ranges with " << total_vmem << " pages, sized "
               << format_size_string(total_vmem * arguments.page_size) << std::endl;
     if (arguments.verbose) {
         for (size_t i = 0; i < ranges.size(); ++i) {
-            size_t num_pages = ranges[i].upper - ranges[i].lower + 1;
+            size_t num_pages = ranges[i].num_pages();
             std::cout << "  " << ranges[i] << " :: " << num_pages << " Pages, "
                       << format_size_string(num_pages * arguments.page_size)
                       << std::endl;
         }
     }
 
+    if (ranges.empty()) {
+        std::cerr << "no ranges to print. exiting now." << std::endl;
+        return 1;
+    }
+
+    // the layout of the ranges is the same in every frame
+    range_index index(ranges);
+    std::unique_ptr<page_layout> layout = make_page_layout(ranges, arguments.layout);
+
+    std::cout << "Placing ranges in a " << layout->width() << "x" << layout->height()
+              << " pixel " << (arguments.layout == LAYOUT_HILBERT ? "hilbert curve" : "treemap")
+              << std::endl;
+
+    // frames repeating an earlier frame share its output
+    std::vector<size_t> original;
+    if (arguments.dedup != DEDUP_NONE) {
+        original = find_duplicate_frames(tracefile);
+
+        size_t duplicates = 0;
+        for (size_t i = 0; i < original.size(); ++i) {
+            duplicates += original[i] != i;
+        }
+        std::cout << "Found " << duplicates << " duplicate frames" << std::endl;
+    }
+
     std::cout << "Writing output frames:    0%" << std::flush;
 
     size_t total_work = tracefile->num_frames;
     size_t work_done = 0;
 
-    #pragma omp parallel for
-    for (size_t i = 0; i < tracefile->num_frames; ++i) {
-        write_frame(path, ranges, total_vmem, tracefile->buffer + tracefile->frame_offsets[i]);
+    #pragma omp parallel
+    {
+        struct frame_context context;
 
-        // progress reporting on the last thread
-        if (omp_get_thread_num() == omp_get_num_threads() - 1) {
-            work_done++;
-            std::cout << "\rWriting output frames:    " 
-                      << work_done * omp_get_num_threads() * 100 / total_work
-                      << "%" << std::flush;
+        #pragma omp for
+        for (size_t i = 0; i < tracefile->num_frames; ++i) {
+            if (original.empty() || original[i] == i) {
+                write_frame(&context, path, index, *layout, trace_frame(tracefile, i));
+            } else if (arguments.dedup == DEDUP_LINK) {
+                link_frame_output(path, tracefile, i, original[i]);
+            }
+
+            // progress reporting on the last thread
+            if (omp_get_thread_num() == omp_get_num_threads() - 1) {
+                work_done++;
+                std::cout << "\rWriting output frames:    "
+                          << work_done * omp_get_num_threads() * 100 / total_work
+                          << "%" << std::flush;
+            }
         }
     }
 
@@ -237,107 +127,37 @@ int backend_png_frames(struct smog_tracefile *tracefile, const char *path) {
     return 0;
 }
 
-struct vma {
-    off_t index;
-    uint64_t lower;
-    uint64_t upper;
-    size_t num_pages;
-};
-
-static int vma_cmp(const void *vma1, const void *vma2) {
-    // sort descending
-    return ((struct vma*)vma2)->num_pages - ((struct vma*)vma1)->num_pages;
-}
-
-static void write_frame(const char *outfile, std::vector<range> ranges,
-                        size_t total_vmem, char *buffer) {
-    // extract the timeval from the frame
-    time_t sec = *(uint32_t*)buffer;
-    uint32_t usec = *(uint32_t*)(buffer + 4);
-
-    struct tm tm;
-    localtime_r(&sec, &tm);
-
-    // produce a string representation of the time
-    char timestr[27];
-    size_t len = strftime(timestr, 20, "%F_%T", &tm);
-    if (len == 0 || len >= 20) {
-        std::cerr << "failed to create output filename" << std::endl;
-        return;
-    }
-    snprintf(timestr + len, 8, ".%06u", usec);
-
+static void write_frame(struct frame_context *context, const char *outfile,
+                        const range_index& index, const page_layout& layout,
+                        trace_frame frame) {
     // produce a path to the output file
-    int n = snprintf(NULL, 0, outfile, timestr);
-    char *outfile_buf = (char*)malloc(n);
-    if (outfile_buf == NULL) {
-        std::cerr << "malloc: " << strerror(errno) << std::endl;
+    if (frame_output_path(outfile, frame, &context->filename) != 0) {
         return;
     }
-    snprintf(outfile_buf, n + 1, outfile, timestr);
+    const char *outfile_buf = context->filename.c_str();
 
     // produce the dimensions of the image
-    size_t yres = sqrt(3 * total_vmem) / 2;
-    size_t xres = (total_vmem + (yres - 1)) / yres;
-
-    // create a squarified treemap of the VMAs
-    // see https://www.win.tue.nl/~vanwijk/stm.pdf
-
-    // procedure squarify(list of real :: children, list of real :: row, real :: w)
-    // begin
-    //     real c = head(children);
-    //     if worst(row, w) <= worst(row ++ [c], w) then
-    //         squarify(tail(children), row ++ [c], w)
-    //     else
-    //         layoutrow(row);
-    //         squarify(children, [], width());
-    //     fi
-    // end
-    //
-    // worst(R; w) = max{r in R}(max((w^2 * r) / s^2; s^2 / (w^2 * r)))
-    //             = max((w^2 * r_max) / s^2; s^2 / (w^2 * r_min))
-
-    // extract the number of VMAs from the frame
-    uint32_t num_vmas = *(uint32_t*)(buffer + 8);
-
-    // index all vma offsets from the frame
-    struct vma *vmas = (struct vma*)calloc(num_vmas, sizeof(*vmas));
-    if (!vmas) {
-        std::cerr << "calloc: " << strerror(errno) << std::endl;
+    size_t xres = layout.width();
+    size_t yres = layout.height();
+
+    // render the frame into the scanlines, the zeroed filter bytes select
+    // no filtering, matching what libpng does for palette images
+    size_t stride = pixel_row_bytes(xres);
+    size_t scanline = stride + 1;
+    context->scanlines.assign(scanline * yres, 0);
+    unsigned char *pixels = context->scanlines.data();
+
+    render_frame_layout(pixels + 1, scanline, index, layout, frame);
+
+    // compress the image with the stream of this thread
+    int res = context->deflate.compress(context->scanlines.data(), context->scanlines.size(),
+                                        &context->compressed);
+    if (res != Z_OK) {
+        std::cerr << outfile_buf << ": deflate: " << zError(res) << std::endl;
         return;
     }
-    
-    size_t index = 12;
-    for (size_t i = 0; i < num_vmas; ++i) {
-        vmas[i].index = index;
-
-        // get vma start and end
-        uint64_t start = *(uint64_t*)(buffer + index);
-        uint64_t end = *(uint64_t*)(buffer + index + 8);
-        index += 16;
-
-        size_t pages = end - start;
-
-        vmas[i].lower = start;
-        vmas[i].upper = end;
-
-        // skip over the name
-        uint32_t length = *(uint32_t*)(buffer + index);
-        index += 4 + length;
-
-        vmas[i].num_pages = pages;
-
-        // skip the words encoding the page bits
-        size_t words = (pages * 2 + (32 - 1)) / 32;
-        index += words * 4;
-    }
-
-    // sort the vma offsets by descending size
-    qsort(vmas, num_vmas, sizeof(*vmas), &vma_cmp);
-
-    // TODO: continue here
 
-    // create the png structures
+    // write the png, libpng frames the compressed image as a single IDAT
     png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
     if (!png) {
         std::cerr << outfile_buf << ": png_write_create_struct: " << strerror(errno) << std::endl;
@@ -349,12 +169,14 @@ static void write_frame(const char *outfile, std::vector<range> ranges,
     png_infop png_info = png_create_info_struct(png);
     if (!png_info) {
         std::cerr << outfile_buf << ": png_create_info_struct: " << strerror(errno) << std::endl;
+        png_destroy_write_struct(&png, NULL);
         return;
     }
 
     FILE *png_fp = fopen(outfile_buf, "wb");
     if (png_fp == NULL) {
         std::cerr << outfile_buf << ": fopen: " << strerror(errno) << std::endl;
+        png_destroy_write_struct(&png, &png_info);
         return;
     }
     png_init_io(png, png_fp);
@@ -362,94 +184,28 @@ static void write_frame(const char *outfile, std::vector<range> ranges,
                  png_info,
                  xres,
                  yres,
-                 8 /* depth */,
-                 PNG_COLOR_TYPE_RGB,
+                 PIXEL_BIT_DEPTH,
+                 PNG_COLOR_TYPE_PALETTE,
                  PNG_INTERLACE_NONE,
                  PNG_COMPRESSION_TYPE_BASE,
                  PNG_FILTER_TYPE_BASE);
 
-    png_colorp palette = (png_colorp)png_malloc(png, PNG_MAX_PALETTE_LENGTH * sizeof(png_color));
-    if (!palette) {
-        std::cerr << outfile_buf << ": png_malloc: " << strerror(errno) << std::endl;
-        return;
+    png_color palette[PIXEL_PALETTE_SIZE];
+    for (size_t i = 0; i < PIXEL_PALETTE_SIZE; ++i) {
+        palette[i].red = pixel_palette[i][0];
+        palette[i].green = pixel_palette[i][1];
+        palette[i].blue = pixel_palette[i][2];
     }
 
-    png_set_PLTE(png, png_info, palette, PNG_MAX_PALETTE_LENGTH);
+    png_set_PLTE(png, png_info, palette, PIXEL_PALETTE_SIZE);
     png_write_info(png, png_info);
-    png_set_packing(png);
-
-    // prepare memory for the image data
-    unsigned char *pixels = (unsigned char*)calloc(xres * yres * 3, sizeof(*pixels));
-    if (!pixels) {
-        std::cerr << outfile_buf << ": calloc: " << strerror(errno) << std::endl;
-        return;
-    }
-
-    index = 12;
-    for (size_t i = 0; i < num_vmas; ++i) {
-        uint64_t start = *(uint64_t*)(buffer + index);
-        uint64_t end = *(uint64_t*)(buffer + index + 8);
-        index += 16;
-
-        size_t pages = end - start;
-
-        size_t pixel_offset = 0;
-        for (size_t j = 0; j < ranges.size(); ++j) {
-            if (start > ranges[j].upper) {
-                pixel_offset += ranges[j].upper - ranges[j].lower + 1;
-            } else if (start > ranges[j].lower) {
-                pixel_offset += start - ranges[j].lower;
-            } else {
-                break;
-            }
-        }
-
-        // skip over the name
-        uint32_t length = *(uint32_t*)(buffer + index);
-        index += 4 + length;
-
-        size_t words = (pages * 2 + (32 - 1)) / 32;
 
-        uint32_t *page_buffer = (uint32_t*)(buffer + index);
-
-        for (size_t j = 0; j < pages; ++j) {
-            int value = (page_buffer[j / 16] >> ((j % 16) * 2)) & 0x3;
-
-            size_t pixel = pixel_offset + j;
-            if (pixel >= xres * yres) {
-                std::cerr << "warning: pixel position out of range" << std::endl;
-                continue;
-            }
+    png_write_chunk(png, (png_const_bytep)"IDAT", context->compressed.data(),
+                    context->compressed.size());
+    png_write_chunk(png, (png_const_bytep)"IEND", NULL, 0);
 
-            // not reserved: black            (0, 0, 0)
-            // reserved and not present: blue (0, 0, 1)
-            // present and not accessed: cyan (0, 1, 1)
-            // accessed and not dirty: green  (0, 1, 0)
-            // dirty: red                     (1, 0, 0)
-
-            pixels[pixel * 3] = (value >= 0x3) ? 255 : 0;
-            pixels[pixel * 3 + 1] = (value >= 0x1 && value <= 0x2) ? 255 : 0;
-            pixels[pixel * 3 + 2] = (value >= 0x0 && value <= 0x1) ? 255 : 0;
-        }
-
-        index += words * 4;
-    }
-
-    png_bytepp rows = (png_bytepp)png_malloc(png, yres * sizeof(png_bytep));
-    if (!rows) {
-        std::cerr << outfile_buf << ": calloc: " << strerror(errno) << std::endl;
-        return;
-    }
-
-    for (size_t i = 0; i < yres; ++i)
-        rows[yres - i - 1] = (pixels + (yres - 1 - i) * xres * 3);
-
-    png_write_image(png, rows);
-    png_write_end(png, png_info);
-
-    png_free(png, palette);
     png_destroy_write_struct(&png, &png_info);
-    fclose(png_fp);
-    free(pixels);
-    free(outfile_buf);
+    if (fclose(png_fp) != 0) {
+        std::cerr << outfile_buf << ": fclose: " << strerror(errno) << std::endl;
+    }
 }
@@ -0,0 +1,399 @@
+/*
+ * Copyright (c) 2022 - 2023 OSM Group @ HPI, University of Potsdam
+ */
+
+#include "backends/png.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <png.h>
+#include <omp.h>
+
+#include "./util.h"
+#include "./trace-iterator.h"
+#include "./pixels.h"
+#include "./range.h"
+#include "./render.h"
+#include "./deflate.h"
+#include "./smog-trace-converter.h"
+
+// the number of rows each thread renders per chunk in streaming mode
+#define STREAMING_ROWS_PER_THREAD 16
+
+// the default size limit of preview images
+#define PREVIEW_SIZE 1024
+
+// the amount of rendered image handed to libpng at once by the buffered
+// encoder, after which a scratch file backing the image is released
+#define BUFFERED_WRITE_SIZE (64 * 1024 * 1024)
+
+// the largest IDAT chunk written by the parallel encoder
+#define PARALLEL_IDAT_SIZE (8 * 1024 * 1024)
+
+static int write_image_buffered(png_structp png, const row_renderer& renderer,
+                                const char *path);
+
+static int write_image_streaming(png_structp png, const row_renderer& renderer);
+
+static int write_image_parallel(png_structp png, const row_renderer& renderer);
+
+int backend_png(struct smog_tracefile *tracefile, const char *path) {
+    // aggregate address ranges
+    printf("Aggregating VMA Ranges:   ");
+    fflush(stdout);
+    size_t max_width = arguments.max_width;
+    size_t max_height = arguments.max_height;
+    if (arguments.preview && !max_width && !max_height) {
+        max_width = max_height = PREVIEW_SIZE;
+    }
+
+    // a preview only reads the frames it shows
+    size_t step = arguments.preview ? bin_size(tracefile->num_frames, max_height) : 1;
+    range_set aggregate = aggregate_vma_ranges(tracefile, step);
+
+    std::vector<range> ranges = aggregate.ranges();
+    size_t num_ranges = ranges.size();
+    size_t total_vmem = aggregate.num_pages();
+
+    printf("found %zu ranges with %zu pages, sized %s\n", num_ranges, total_vmem,
+           format_size_string(total_vmem * arguments.page_size));
+    if (arguments.verbose) {
+        for (size_t i = 0; i < num_ranges; ++i) {
+            size_t num_pages = ranges[i].num_pages();
+            printf("  (%#zx, %#zx) :: %zu Pages, %s\n",
+                   ranges[i].lower, ranges[i].upper, num_pages,
+                   format_size_string(num_pages * arguments.page_size));
+        }
+    }
+
+    if (!num_ranges) {
+        fprintf(stderr, "no ranges to print. exiting now.\n");
+        return 1;
+    }
+
+    // prepare output file
+    range_index index(ranges);
+    row_renderer renderer(tracefile, index, max_width, max_height, arguments.reduction,
+                          arguments.preview);
+
+    size_t xres = renderer.width();
+    size_t yres = renderer.height();
+
+    if (renderer.pages_per_pixel() > 1 || renderer.frames_per_pixel() > 1) {
+        printf("Binning %zu pages and %zu frames per pixel\n", renderer.pages_per_pixel(),
+               renderer.frames_per_pixel());
+    }
+
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!png) {
+        fprintf(stderr, "%s: ", path);
+        perror("png_write_create_struct");
+        return 1;
+    }
+
+    png_set_user_limits(png, 0x7fffffff, 0x7fffffff);
+
+    png_infop png_info = png_create_info_struct(png);
+    if (!png_info) {
+        fprintf(stderr, "%s: ", path);
+        perror("png_create_info_struct");
+        return 1;
+    }
+
+    FILE *png_fp = fopen(path, "wb");
+    if (png_fp == NULL) {
+        fprintf(stderr, "%s: ", path);
+        perror("fopen");
+        return 1;
+    }
+    png_init_io(png, png_fp);
+    png_set_IHDR(png,
+                 png_info,
+                 xres,
+                 yres,
+                 PIXEL_BIT_DEPTH,
+                 PNG_COLOR_TYPE_PALETTE,
+                 PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_BASE,
+                 PNG_FILTER_TYPE_BASE);
+
+    unsigned char colors[PIXEL_GRADIENT_SIZE][3];
+    size_t num_colors = renderer.palette(colors);
+
+    png_colorp palette = (png_colorp)png_malloc(png, num_colors * sizeof(png_color));
+    if (!palette) {
+        fprintf(stderr, "%s: ", path);
+        perror("png_malloc");
+        return 1;
+    }
+
+    for (size_t i = 0; i < num_colors; ++i) {
+        palette[i].red = colors[i][0];
+        palette[i].green = colors[i][1];
+        palette[i].blue = colors[i][2];
+    }
+
+    png_set_PLTE(png, png_info, palette, num_colors);
+    png_write_info(png, png_info);
+
+    int res;
+    switch (arguments.png_encoder) {
+        case PNG_ENCODER_STREAMING:
+            res = write_image_streaming(png, renderer);
+            break;
+        case PNG_ENCODER_PARALLEL:
+            res = write_image_parallel(png, renderer);
+            break;
+        default:
+            res = write_image_buffered(png, renderer, path);
+            break;
+    }
+
+    if (res != 0) {
+        png_free(png, palette);
+        png_destroy_write_struct(&png, &png_info);
+        fclose(png_fp);
+        return 1;
+    }
+
+    // the parallel encoder bypasses libpng for the image data and ends the
+    // file itself
+    if (arguments.png_encoder != PNG_ENCODER_PARALLEL) {
+        png_write_end(png, png_info);
+    }
+    printf("OK\n");
+
+    printf("Successfully created %zux%zu pixel output image.\n", xres, yres);
+
+    // cleanup
+    png_free(png, palette);
+    png_destroy_write_struct(&png, &png_info);
+    fclose(png_fp);
+
+    return 0;
+}
+
+// allocate the zeroed buffer of the rendered image. with a scratch directory
+// the buffer is a shared mapping of a sparse, unlinked file there, which the
+// kernel can write back and evict under memory pressure.
+static unsigned char *allocate_pixels(size_t size, const char *path) {
+    if (!arguments.scratch_dir) {
+        unsigned char *pixels = (unsigned char*)calloc(size, sizeof(*pixels));
+        if (!pixels) {
+            fprintf(stderr, "%s: ", path);
+            perror("calloc");
+        }
+        return pixels;
+    }
+
+    std::string scratch = std::string(arguments.scratch_dir) + "/smog-pixels-XXXXXX";
+    int fd = mkstemp(&scratch[0]);
+    if (fd < 0) {
+        fprintf(stderr, "%s: ", scratch.c_str());
+        perror("mkstemp");
+        return NULL;
+    }
+    unlink(scratch.c_str());
+
+    if (ftruncate(fd, size) != 0) {
+        fprintf(stderr, "%s: ", scratch.c_str());
+        perror("ftruncate");
+        close(fd);
+        return NULL;
+    }
+
+    void *pixels = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, fd, 0);
+    close(fd);
+    if (pixels == MAP_FAILED) {
+        fprintf(stderr, "%s: ", scratch.c_str());
+        perror("mmap");
+        return NULL;
+    }
+
+    madvise(pixels, size, MADV_SEQUENTIAL);
+
+    return (unsigned char*)pixels;
+}
+
+static void free_pixels(unsigned char *pixels, size_t size) {
+    if (arguments.scratch_dir) {
+        munmap(pixels, size);
+    } else {
+        free(pixels);
+    }
+}
+
+// render the whole image into memory, then hand it to libpng
+static int write_image_buffered(png_structp png, const row_renderer& renderer,
+                                const char *path) {
+    printf("Writing output frames:    0%%");
+    fflush(stdout);
+
+    size_t yres = renderer.height();
+    size_t stride = pixel_row_bytes(renderer.width());
+    unsigned char *pixels = allocate_pixels(stride * yres, path);
+    if (!pixels) {
+        return 1;
+    }
+
+    size_t total_work = yres;
+    size_t work_done = 0;
+
+    // hand out rows in ascending order, so that all threads fill the image
+    // front to back instead of each thread touching its own region
+    #pragma omp parallel for schedule(dynamic, STREAMING_ROWS_PER_THREAD)
+    for (size_t i = 0; i < yres; ++i) {
+        renderer.render(pixels + i * stride, i);
+
+        // progress reporting on the last thread
+        if (omp_get_thread_num() == omp_get_num_threads() - 1) {
+            work_done++;
+            printf("\rWriting output frames:    %zu%%",
+                   work_done * omp_get_num_threads() * 100 / total_work);
+            fflush(stdout);
+        }
+    }
+
+    printf("\rWriting output frames:    100%%\n");
+    printf("Creating output file:     ");
+    fflush(stdout);
+
+    png_bytepp rows = (png_bytepp)png_malloc(png, yres * sizeof(png_bytep));
+    if (!rows) {
+        fprintf(stderr, "%s: ", path);
+        perror("calloc");
+        free_pixels(pixels, stride * yres);
+        return 1;
+    }
+
+    for (size_t i = 0; i < yres; ++i)
+        rows[yres - i - 1] = (pixels + (yres - 1 - i) * stride);
+
+    // emit the image in pieces, dropping each piece of a scratch file once
+    // it is compressed, so that it is neither kept in the page cache nor
+    // written back to disk
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t released = 0;
+    size_t piece_rows = std::max<size_t>(1, BUFFERED_WRITE_SIZE / stride);
+    for (size_t first = 0; first < yres; first += piece_rows) {
+        size_t count = std::min(piece_rows, yres - first);
+        png_write_rows(png, rows + first, count);
+
+        if (arguments.scratch_dir) {
+            size_t end = (first + count) * stride / page_size * page_size;
+            if (end > released) {
+                madvise(pixels + released, end - released, MADV_REMOVE);
+                released = end;
+            }
+        }
+    }
+
+    png_free(png, rows);
+    free_pixels(pixels, stride * yres);
+
+    return 0;
+}
+
+// render bounded chunks of rows in parallel and emit them in order, so that
+// only a few rows per thread are held in memory at any time
+static int write_image_streaming(png_structp png, const row_renderer& renderer) {
+    printf("Writing output frames:    0%%");
+    fflush(stdout);
+
+    size_t yres = renderer.height();
+    size_t chunk_rows = omp_get_max_threads() * STREAMING_ROWS_PER_THREAD;
+    size_t stride = pixel_row_bytes(renderer.width());
+    std::vector<unsigned char> chunk(chunk_rows * stride);
+
+    for (size_t first = 0; first < yres; first += chunk_rows) {
+        size_t count = std::min(chunk_rows, yres - first);
+
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < count; ++i) {
+            unsigned char *row = chunk.data() + i * stride;
+            memset(row, 0, stride);
+            renderer.render(row, first + i);
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            png_write_row(png, chunk.data() + i * stride);
+        }
+
+        printf("\rWriting output frames:    %zu%%", (first + count) * 100 / yres);
+        fflush(stdout);
+    }
+
+    printf("\rWriting output frames:    100%%\n");
+    printf("Creating output file:     ");
+    fflush(stdout);
+
+    return 0;
+}
+
+static void write_idat(png_structp png, const std::vector<unsigned char>& data) {
+    for (size_t offset = 0; offset < data.size(); offset += PARALLEL_IDAT_SIZE) {
+        size_t length = std::min<size_t>(PARALLEL_IDAT_SIZE, data.size() - offset);
+        png_write_chunk(png, (png_const_bytep)"IDAT", data.data() + offset, length);
+    }
+}
+
+// render chunks of rows like the streaming encoder, but filter and compress
+// them on all threads, bypassing the single threaded compression in libpng.
+// libpng still writes the header chunks and frames the IDAT chunks.
+static int write_image_parallel(png_structp png, const row_renderer& renderer) {
+    printf("Writing output frames:    0%%");
+    fflush(stdout);
+
+    // every scanline starts with its filter type, palette images are not
+    // filtered, matching what libpng does for them
+    size_t yres = renderer.height();
+    size_t stride = pixel_row_bytes(renderer.width());
+    size_t scanline = stride + 1;
+
+    // give every thread at least one block of input to compress
+    size_t thread_rows = std::max<size_t>(STREAMING_ROWS_PER_THREAD,
+                                          (DEFLATE_MIN_BLOCK + scanline - 1) / scanline);
+    size_t chunk_rows = omp_get_max_threads() * thread_rows;
+    std::vector<unsigned char> chunk(chunk_rows * scanline);
+    std::vector<unsigned char> compressed;
+
+    parallel_deflate deflate;
+
+    for (size_t first = 0; first < yres; first += chunk_rows) {
+        size_t count = std::min(chunk_rows, yres - first);
+
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < count; ++i) {
+            unsigned char *row = chunk.data() + i * scanline;
+            memset(row, 0, scanline);
+            row[0] = PNG_FILTER_VALUE_NONE;
+            renderer.render(row + 1, first + i);
+        }
+
+        compressed.clear();
+        if (deflate.compress(chunk.data(), count * scanline, first + count == yres,
+                             &compressed) != 0) {
+            return 1;
+        }
+        write_idat(png, compressed);
+
+        printf("\rWriting output frames:    %zu%%", (first + count) * 100 / yres);
+        fflush(stdout);
+    }
+
+    png_write_chunk(png, (png_const_bytep)"IEND", NULL, 0);
+
+    printf("\rWriting output frames:    100%%\n");
+    printf("Creating output file:     ");
+    fflush(stdout);
+
+    return 0;
+}
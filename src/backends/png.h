@@ -7,6 +7,14 @@
 
 #include "./tracefile.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 int backend_png(struct smog_tracefile *tracefile, const char *path);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif  // BACKENDS_PNG_H_
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2022 - 2023 OSM Group @ HPI, University of Potsdam
+ */
+
+#include "backends/summary.h"
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+
+#include <omp.h>
+
+#include "./trace-iterator.h"
+#include "./page-states.h"
+#include "./smog-trace-converter.h"
+
+// the number of frames summarized in parallel before their rows are written
+#define SUMMARY_BATCH 1024
+
+static void summarize_frame(std::string *rows, size_t i, trace_frame frame);
+
+int backend_summary(struct smog_tracefile *tracefile, const char *path) {
+    std::ofstream outfile(path);
+    if (!outfile) {
+        std::cerr << path << ": unable to open output file" << std::endl;
+        return 1;
+    }
+
+    outfile << "frame,timestamp,vma,start,end,pages,present,accessed,dirty\n";
+
+    std::cout << "Summarizing frames:       0%" << std::flush;
+
+    std::vector<std::string> rows(SUMMARY_BATCH);
+
+    for (size_t batch = 0; batch < tracefile->num_frames; batch += SUMMARY_BATCH) {
+        size_t count = std::min<size_t>(SUMMARY_BATCH, tracefile->num_frames - batch);
+
+        #pragma omp parallel for
+        for (size_t i = 0; i < count; ++i) {
+            rows[i].clear();
+            summarize_frame(&rows[i], batch + i, trace_frame(tracefile, batch + i));
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            outfile << rows[i];
+        }
+
+        std::cout << "\rSummarizing frames:       "
+                  << (batch + count) * 100 / tracefile->num_frames << "%" << std::flush;
+    }
+
+    std::cout << "\rSummarizing frames:       100%" << std::endl;
+
+    outfile.close();
+    if (!outfile) {
+        std::cerr << path << ": failed to write output file" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+static void summarize_frame(std::string *rows, size_t i, trace_frame frame) {
+    char line[256];
+
+    for (const trace_vma& vma : frame) {
+        if (arguments.filter_vma && vma.name != arguments.filter_vma) {
+            continue;
+        }
+
+        struct page_state_counts counts;
+        count_page_states(vma.words, vma.num_pages(), &counts);
+
+        int n = snprintf(line, sizeof(line), "%zu,%u.%06u,\"", i, frame.sec(), frame.usec());
+        rows->append(line, n);
+
+        // quote the name, csv escapes quotes by doubling them
+        for (char c : vma.name) {
+            if (c == '"') {
+                rows->push_back('"');
+            }
+            rows->push_back(c);
+        }
+
+        n = snprintf(line, sizeof(line), "\",%#zx,%#zx,%zu,%zu,%zu,%zu\n",
+                     vma.start * arguments.page_size, vma.end * arguments.page_size,
+                     counts.pages, counts.present, counts.accessed, counts.dirty);
+        rows->append(line, n);
+    }
+}
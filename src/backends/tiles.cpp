@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2022 - 2023 OSM Group @ HPI, University of Potsdam
+ */
+
+#include "backends/tiles.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <sys/stat.h>
+#include <omp.h>
+
+#include "./util.h"
+#include "./pixels.h"
+#include "./range.h"
+#include "./render.h"
+#include "./smog-trace-converter.h"
+
+// the edge length of the square tiles
+#define TILE_SIZE 256
+
+// one level of the pyramid, holding the band of rows for the current row
+// of tiles. level 0 is the full resolution image, each following level
+// halves both dimensions.
+struct pyramid_level {
+    size_t width;
+    size_t height;
+    size_t stride;
+    std::string directory;
+
+    std::vector<unsigned char> band;
+    size_t rows;
+    size_t tile_row;
+};
+
+static int make_directory(const std::string& path) {
+    if (mkdir(path.c_str(), 0777) != 0 && errno != EEXIST) {
+        fprintf(stderr, "%s: mkdir: %s\n", path.c_str(), strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+static int write_descriptor(const char *path, size_t width, size_t height) {
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "%s: fopen: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    fprintf(fp,
+            "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\"\n"
+            "       Format=\"png\" Overlap=\"0\" TileSize=\"%d\">\n"
+            "  <Size Width=\"%zu\" Height=\"%zu\"/>\n"
+            "</Image>\n", TILE_SIZE, width, height);
+
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "%s: fclose: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    return 0;
+}
+
+// reduce the band of a level into the band of the next coarser level. each
+// pixel takes the highest index of the 2x2 pixels it covers, that is the
+// most active page state.
+static void reduce_band(const struct pyramid_level& from, struct pyramid_level *to) {
+    size_t rows = (from.rows + 1) / 2;
+
+    #pragma omp parallel for schedule(static)
+    for (size_t y = 0; y < rows; ++y) {
+        const unsigned char *upper = from.band.data() + (2 * y) * from.stride;
+        const unsigned char *lower = (2 * y + 1 < from.rows) ? upper + from.stride : upper;
+        unsigned char *row = to->band.data() + (to->rows + y) * to->stride;
+
+        for (size_t x = 0; x < to->width; ++x) {
+            size_t right = std::min(2 * x + 1, from.width - 1);
+            unsigned value = std::max({ get_pixel(upper, 2 * x), get_pixel(upper, right),
+                                        get_pixel(lower, 2 * x), get_pixel(lower, right) });
+            set_pixel(row, x, value);
+        }
+    }
+
+    to->rows += rows;
+}
+
+// write the tiles of the current band of a level and propagate the band into
+// the coarser levels, emitting their bands once they are full.
+static int emit_band(std::vector<struct pyramid_level> *levels, size_t r, bool final) {
+    struct pyramid_level& level = (*levels)[r];
+
+    size_t columns = (level.width + TILE_SIZE - 1) / TILE_SIZE;
+    int failed = 0;
+
+    #pragma omp parallel for schedule(dynamic, 1) reduction(|:failed)
+    for (size_t c = 0; c < columns; ++c) {
+        size_t width = std::min<size_t>(TILE_SIZE, level.width - c * TILE_SIZE);
+
+        // tiles start on even pixels, so they start on whole bytes
+        unsigned char *rows[TILE_SIZE];
+        for (size_t y = 0; y < level.rows; ++y) {
+            rows[y] = level.band.data() + y * level.stride + c * TILE_SIZE / 2;
+        }
+
+        std::string path = level.directory + "/" + std::to_string(c) + "_"
+                           + std::to_string(level.tile_row) + ".png";
+        failed |= write_palette_png(path.c_str(), width, level.rows, rows);
+    }
+
+    if (failed) {
+        return 1;
+    }
+
+    if (r + 1 < levels->size()) {
+        struct pyramid_level& next = (*levels)[r + 1];
+        reduce_band(level, &next);
+
+        if (next.rows == TILE_SIZE || final) {
+            if (emit_band(levels, r + 1, final) != 0) {
+                return 1;
+            }
+        }
+    }
+
+    level.rows = 0;
+    level.tile_row++;
+
+    return 0;
+}
+
+int backend_tiles(struct smog_tracefile *tracefile, const char *path) {
+    // aggregate address ranges
+    printf("Aggregating VMA Ranges:   ");
+    fflush(stdout);
+    range_set aggregate = aggregate_vma_ranges(tracefile);
+
+    std::vector<range> ranges = aggregate.ranges();
+    size_t total_vmem = aggregate.num_pages();
+
+    printf("found %zu ranges with %zu pages, sized %s\n", ranges.size(), total_vmem,
+           format_size_string(total_vmem * arguments.page_size));
+
+    if (ranges.empty() || !tracefile->num_frames) {
+        fprintf(stderr, "no ranges to print. exiting now.\n");
+        return 1;
+    }
+
+    size_t xres = total_vmem;
+    size_t yres = tracefile->num_frames;
+
+    // the tiles go next to the descriptor, into NAME_files/LEVEL/COLUMN_ROW.png
+    std::string base(path);
+    size_t ext = base.rfind('.');
+    if (ext != std::string::npos && base.find('/', ext) == std::string::npos) {
+        base.erase(ext);
+    }
+    std::string directory = base + "_files";
+
+    // deep zoom levels count up from a single pixel to the full resolution
+    size_t max_level = 0;
+    while (((size_t)1 << max_level) < std::max(xres, yres)) {
+        max_level++;
+    }
+
+    if (make_directory(directory) != 0) {
+        return 1;
+    }
+
+    std::vector<struct pyramid_level> levels(max_level + 1);
+    for (size_t r = 0; r <= max_level; ++r) {
+        struct pyramid_level& level = levels[r];
+        level.width = (xres + ((size_t)1 << r) - 1) >> r;
+        level.height = (yres + ((size_t)1 << r) - 1) >> r;
+        level.stride = pixel_row_bytes(level.width);
+        level.directory = directory + "/" + std::to_string(max_level - r);
+        level.band.resize(level.stride * TILE_SIZE);
+        level.rows = 0;
+        level.tile_row = 0;
+
+        if (make_directory(level.directory) != 0) {
+            return 1;
+        }
+    }
+
+    printf("Writing output tiles:     0%%");
+    fflush(stdout);
+
+    range_index index(ranges);
+    struct pyramid_level& base_level = levels[0];
+
+    for (size_t first = 0; first < yres; first += TILE_SIZE) {
+        size_t count = std::min<size_t>(TILE_SIZE, yres - first);
+
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < count; ++i) {
+            unsigned char *row = base_level.band.data() + i * base_level.stride;
+            memset(row, 0, base_level.stride);
+            render_frame_row(row, index, xres, trace_frame(tracefile, first + i));
+        }
+        base_level.rows = count;
+
+        if (emit_band(&levels, 0, first + count == yres) != 0) {
+            return 1;
+        }
+
+        printf("\rWriting output tiles:     %zu%%", (first + count) * 100 / yres);
+        fflush(stdout);
+    }
+
+    printf("\rWriting output tiles:     100%%\n");
+
+    if (write_descriptor(path, xres, yres) != 0) {
+        return 1;
+    }
+
+    printf("Successfully created %zux%zu pixel image in %zu levels.\n", xres, yres,
+           max_level + 1);
+
+    return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2022 - 2023 OSM Group @ HPI, University of Potsdam
+ */
+
+#include "./deflate.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <omp.h>
+
+struct deflate_block {
+    const unsigned char *data;
+    size_t size;
+    const unsigned char *dictionary;
+    size_t dictionary_size;
+    bool last;
+
+    std::vector<unsigned char> output;
+    uint32_t adler;
+    int result;
+};
+
+static int compress_block(struct deflate_block *block, int level) {
+    z_stream strm = {};
+
+    // raw deflate, the zlib framing is written around all blocks
+    int res = deflateInit2(&strm, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    if (res != Z_OK) {
+        return res;
+    }
+
+    if (block->dictionary_size) {
+        res = deflateSetDictionary(&strm, block->dictionary, block->dictionary_size);
+        if (res != Z_OK) {
+            deflateEnd(&strm);
+            return res;
+        }
+    }
+
+    // deflateBound does not account for the sync flush marker
+    block->output.resize(deflateBound(&strm, block->size) + 16);
+
+    strm.next_in = const_cast<unsigned char*>(block->data);
+    strm.avail_in = block->size;
+    strm.next_out = block->output.data();
+    strm.avail_out = block->output.size();
+
+    res = deflate(&strm, block->last ? Z_FINISH : Z_SYNC_FLUSH);
+    if (res != (block->last ? Z_STREAM_END : Z_OK) || strm.avail_in) {
+        deflateEnd(&strm);
+        return res == Z_OK ? Z_BUF_ERROR : res;
+    }
+
+    block->output.resize(strm.total_out);
+    block->adler = adler32(adler32(0, NULL, 0), block->data, block->size);
+
+    deflateEnd(&strm);
+
+    return Z_OK;
+}
+
+parallel_deflate::parallel_deflate(int level)
+        : level(level), started(false), adler(adler32(0, NULL, 0)) {}
+
+int parallel_deflate::compress(const unsigned char *data, size_t size, bool final,
+                               std::vector<unsigned char> *out) {
+    if (!started) {
+        // CMF: deflate with a 32 KiB window, FLG: default compression
+        out->push_back(0x78);
+        out->push_back(0x9c);
+        started = true;
+    }
+
+    size_t num_blocks = std::max<size_t>(1, std::min<size_t>(omp_get_max_threads(),
+                                                             size / DEFLATE_MIN_BLOCK));
+    size_t block_size = size / num_blocks;
+
+    std::vector<struct deflate_block> blocks(num_blocks);
+    for (size_t i = 0; i < num_blocks; ++i) {
+        struct deflate_block *block = &blocks[i];
+        block->data = data + i * block_size;
+        block->size = (i == num_blocks - 1) ? size - i * block_size : block_size;
+        block->last = final && i == num_blocks - 1;
+
+        if (i) {
+            // prime with the end of the previous block
+            block->dictionary_size = std::min<size_t>(DEFLATE_WINDOW, block_size);
+            block->dictionary = block->data - block->dictionary_size;
+        } else {
+            // prime with the end of the previous piece
+            block->dictionary_size = history.size();
+            block->dictionary = history.data();
+        }
+    }
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < num_blocks; ++i) {
+        blocks[i].result = compress_block(&blocks[i], level);
+    }
+
+    for (const struct deflate_block& block : blocks) {
+        if (block.result != Z_OK) {
+            std::cerr << "deflate: " << zError(block.result) << std::endl;
+            return 1;
+        }
+
+        out->insert(out->end(), block.output.begin(), block.output.end());
+        adler = adler32_combine(adler, block.adler, block.size);
+    }
+
+    // keep the last 32 KiB of input to prime the next piece
+    if (size >= DEFLATE_WINDOW) {
+        history.assign(data + size - DEFLATE_WINDOW, data + size);
+    } else {
+        history.insert(history.end(), data, data + size);
+        if (history.size() > DEFLATE_WINDOW) {
+            history.erase(history.begin(), history.end() - DEFLATE_WINDOW);
+        }
+    }
+
+    if (final) {
+        // the trailer holds the Adler-32 of all input, big endian
+        out->push_back(adler >> 24);
+        out->push_back(adler >> 16);
+        out->push_back(adler >> 8);
+        out->push_back(adler);
+    }
+
+    return 0;
+}
+
+deflate_stream::deflate_stream(int level) : strm(), status(deflateInit(&strm, level)) {}
+
+deflate_stream::~deflate_stream() {
+    if (status == Z_OK) {
+        deflateEnd(&strm);
+    }
+}
+
+int deflate_stream::compress(const unsigned char *data, size_t size,
+                             std::vector<unsigned char> *out) {
+    if (status != Z_OK) {
+        return status;
+    }
+
+    deflateReset(&strm);
+    out->resize(deflateBound(&strm, size));
+
+    strm.next_in = const_cast<unsigned char*>(data);
+    strm.avail_in = size;
+    strm.next_out = out->data();
+    strm.avail_out = out->size();
+
+    int res = deflate(&strm, Z_FINISH);
+    if (res != Z_STREAM_END) {
+        return res == Z_OK ? Z_BUF_ERROR : res;
+    }
+
+    out->resize(strm.total_out);
+
+    return Z_OK;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2022 - 2023 OSM Group @ HPI, University of Potsdam
+ */
+
+#ifndef DEFLATE_H_
+#define DEFLATE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <zlib.h>
+
+// the smallest amount of input compressed as an independent block
+#define DEFLATE_MIN_BLOCK (128 * 1024)
+
+// the deflate window, blocks are primed with this much preceding input
+#define DEFLATE_WINDOW (32 * 1024)
+
+// produces a single zlib stream from consecutive pieces of input, in the
+// style of pigz. each piece is split into blocks that are compressed
+// independently on all threads, every block primed with the 32 KiB of input
+// preceding it as dictionary. all but the last block end in a sync flush,
+// so that the raw deflate outputs concatenate into one valid stream, and the
+// Adler-32 checksums of the blocks are combined for the zlib trailer.
+class parallel_deflate {
+ public:
+    explicit parallel_deflate(int level = Z_DEFAULT_COMPRESSION);
+
+    // compress the next piece of input and append the compressed bytes to
+    // out. the first call emits the zlib header, passing final emits the
+    // last block and the trailer, after which the stream is complete.
+    int compress(const unsigned char *data, size_t size, bool final,
+                 std::vector<unsigned char> *out);
+
+ private:
+    int level;
+    bool started;
+    uint32_t adler;
+    std::vector<unsigned char> history;
+};
+
+// a zlib stream that compresses many independent inputs one after another,
+// keeping its state allocated in between
+class deflate_stream {
+ public:
+    explicit deflate_stream(int level = Z_DEFAULT_COMPRESSION);
+    ~deflate_stream();
+
+    deflate_stream(const deflate_stream&) = delete;
+    deflate_stream& operator=(const deflate_stream&) = delete;
+
+    // compress data into a complete zlib stream, replacing the contents of
+    // out. returns a zlib status code.
+    int compress(const unsigned char *data, size_t size, std::vector<unsigned char> *out);
+
+ private:
+    z_stream strm;
+    int status;
+};
+
+#endif  // DEFLATE_H_
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2022 - 2023 OSM Group @ HPI, University of Potsdam
+ */
+
+#include "./frame-output.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <unordered_map>
+
+#include <unistd.h>
+
+#include "./util.h"
+
+int frame_output_path(const char *pattern, trace_frame frame, std::string *path) {
+    // extract the timeval from the frame
+    time_t sec = frame.sec();
+    uint32_t usec = frame.usec();
+
+    struct tm tm;
+    localtime_r(&sec, &tm);
+
+    // produce a string representation of the time
+    char timestr[27];
+    size_t len = strftime(timestr, 20, "%F_%T", &tm);
+    if (len == 0 || len >= 20) {
+        fprintf(stderr, "failed to create output filename\n");
+        return 1;
+    }
+    snprintf(timestr + len, 8, ".%06u", usec);
+
+    // produce a path to the output file
+    int n = snprintf(NULL, 0, pattern, timestr);
+    path->resize(n + 1);
+    snprintf(&(*path)[0], n + 1, pattern, timestr);
+    path->resize(n);
+
+    return 0;
+}
+
+std::vector<size_t> find_duplicate_frames(const struct smog_tracefile *tracefile) {
+    // hash the VMA headers and page words of each frame on all threads
+    std::vector<uint64_t> hashes(tracefile->num_frames);
+
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (size_t i = 0; i < tracefile->num_frames; ++i) {
+        const char *frame = tracefile->buffer + tracefile->frame_offsets[i];
+        hashes[i] = hash_bytes(frame + 8, tracefile->frame_lengths[i] - 8);
+    }
+
+    std::vector<size_t> original(tracefile->num_frames);
+    std::unordered_map<uint64_t, size_t> first;
+
+    for (size_t i = 0; i < tracefile->num_frames; ++i) {
+        original[i] = i;
+
+        auto it = first.emplace(hashes[i], i);
+        if (it.second) {
+            continue;
+        }
+
+        // compare everything after the timestamps
+        size_t j = it.first->second;
+        size_t length = tracefile->frame_lengths[i];
+        if (length == tracefile->frame_lengths[j]
+                && !memcmp(tracefile->buffer + tracefile->frame_offsets[i] + 8,
+                           tracefile->buffer + tracefile->frame_offsets[j] + 8, length - 8)) {
+            original[i] = j;
+        }
+    }
+
+    return original;
+}
+
+static std::string directory_of(const std::string& path) {
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+int link_frame_output(const char *pattern, struct smog_tracefile *tracefile, size_t frame,
+                      size_t original) {
+    std::string path, target;
+    if (frame_output_path(pattern, trace_frame(tracefile, frame), &path) != 0
+            || frame_output_path(pattern, trace_frame(tracefile, original), &target) != 0) {
+        return 1;
+    }
+
+    // links are resolved relative to their own directory
+    std::string directory = directory_of(target);
+    if (directory == directory_of(path)) {
+        target.erase(0, directory.size());
+    } else if (target[0] != '/') {
+        char *cwd = getcwd(NULL, 0);
+        if (!cwd) {
+            perror("getcwd");
+            return 1;
+        }
+        target = std::string(cwd) + "/" + target;
+        free(cwd);
+    }
+
+    // replace the output of an earlier run
+    if (unlink(path.c_str()) != 0 && errno != ENOENT) {
+        fprintf(stderr, "%s: unlink: %s\n", path.c_str(), strerror(errno));
+        return 1;
+    }
+
+    if (symlink(target.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "%s: symlink: %s\n", path.c_str(), strerror(errno));
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2022 - 2023 OSM Group @ HPI, University of Potsdam
+ */
+
+#ifndef FRAME_OUTPUT_H_
+#define FRAME_OUTPUT_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "./tracefile.h"
+#include "./trace-iterator.h"
+
+// produce the path of the output file of a frame from a pattern holding %s
+// for the time of the frame. returns 0 on success.
+int frame_output_path(const char *pattern, trace_frame frame, std::string *path);
+
+// find the frames that repeat an earlier frame, by hashes of their contents
+// after the timestamp. every frame maps to the first frame with identical
+// contents, so unique frames map to themselves. the contents of frames with
+// equal hashes are compared, so a collision never merges different frames.
+// this reads the whole trace, so it is only done when deduplicating.
+std::vector<size_t> find_duplicate_frames(const struct smog_tracefile *tracefile);
+
+// make the output file of a duplicate frame a symbolic link to the output of
+// the frame it repeats. returns 0 on success.
+int link_frame_output(const char *pattern, struct smog_tracefile *tracefile, size_t frame,
+                      size_t original);
+
+#endif  // FRAME_OUTPUT_H_
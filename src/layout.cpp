@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2022 - 2023 OSM Group @ HPI, University of Potsdam
+ */
+
+#include "./layout.h"
+
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+
+#include "./pixels.h"
+
+// the factor by which the image grows when rounding the treemap to whole
+// pixels leaves a range without enough room for its pages
+#define LAYOUT_GROWTH 1.05
+
+struct treemap_item {
+    size_t index;
+    size_t pages;
+    double area;
+};
+
+// the worst aspect ratio in a row of items laid along side, given the
+// largest and smallest area in the row and their sum
+static double worst(double largest, double smallest, double sum, double side) {
+    double side2 = side * side;
+    double sum2 = sum * sum;
+    return std::max(side2 * largest / sum2, sum2 / (side2 * smallest));
+}
+
+treemap_layout::treemap_layout(const std::vector<range>& ranges) {
+    // start with the aspect ratio of the linear layout and grow the image
+    // until every range fits into its rectangle
+    for (double scale = 1.0; !place(ranges, scale); scale *= LAYOUT_GROWTH) {}
+}
+
+bool treemap_layout::place(const std::vector<range>& ranges, double scale) {
+    size_t total = 0;
+    offsets.resize(ranges.size());
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        offsets[i] = total;
+        total += ranges[i].num_pages();
+    }
+
+    rects.resize(ranges.size());
+    if (!total) {
+        xres = yres = 1;
+        return true;
+    }
+
+    yres = std::max<size_t>(1, std::sqrt(3.0 * total * scale) / 2);
+    xres = std::max<size_t>(1, std::ceil(total * scale / yres));
+
+    // the treemap is built from the largest range to the smallest
+    std::vector<treemap_item> items(ranges.size());
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        items[i].index = i;
+        items[i].pages = ranges[i].num_pages();
+        items[i].area = (double)items[i].pages * xres * yres / total;
+    }
+    std::stable_sort(items.begin(), items.end(),
+                     [](const treemap_item& a, const treemap_item& b) {
+                         return a.pages > b.pages;
+                     });
+
+    // the free part of the image
+    size_t x0 = 0, y0 = 0, x1 = xres, y1 = yres;
+
+    for (size_t i = 0; i < items.size();) {
+        if (x0 >= x1 || y0 >= y1) {
+            return false;
+        }
+
+        bool vertical = x1 - x0 >= y1 - y0;
+        size_t side = vertical ? y1 - y0 : x1 - x0;
+        size_t depth = vertical ? x1 - x0 : y1 - y0;
+
+        // extend the row for as long as its worst aspect ratio improves
+        size_t j = i + 1;
+        double sum = items[i].area;
+        double current = worst(items[i].area, items[i].area, sum, side);
+        while (j < items.size()) {
+            double next = worst(items[i].area, items[j].area, sum + items[j].area, side);
+            if (next > current) {
+                break;
+            }
+            current = next;
+            sum += items[j++].area;
+        }
+
+        // round the row to whole pixels, leaving room for the items after
+        // it. the row gets thicker until every item has room for its pages
+        // along the side, at least one pixel each.
+        size_t room = (j < items.size()) ? depth - 1 : depth;
+        size_t thickness = std::max<size_t>(1, sum / side);
+        size_t length;
+        for (;; ++thickness) {
+            if (thickness > room) {
+                return false;
+            }
+
+            length = 0;
+            for (size_t k = i; k < j; ++k) {
+                length += (items[k].pages + thickness - 1) / thickness;
+            }
+            if (length <= side) {
+                break;
+            }
+        }
+
+        // hand out the remaining pixels along the side by area, the last
+        // item takes what is left after rounding
+        size_t spare = side - length;
+        size_t position = vertical ? y0 : x0;
+        for (size_t k = i; k < j; ++k) {
+            const treemap_item& item = items[k];
+            size_t extent = (item.pages + thickness - 1) / thickness;
+            if (k == j - 1) {
+                extent = (vertical ? y1 : x1) - position;
+            } else {
+                extent += std::min<size_t>(spare, spare * item.area / sum);
+            }
+
+            layout_rect& rect = rects[item.index];
+            rect.x = vertical ? x0 : position;
+            rect.y = vertical ? position : y0;
+            rect.width = vertical ? thickness : extent;
+            rect.height = vertical ? extent : thickness;
+            rect.offset = offsets[item.index];
+            rect.pages = item.pages;
+
+            position += extent;
+        }
+
+        if (vertical) {
+            x0 += thickness;
+        } else {
+            y0 += thickness;
+        }
+
+        i = j;
+    }
+
+    return true;
+}
+
+void treemap_layout::fill(unsigned char *pixels, size_t stride, size_t offset,
+                          const uint8_t *states, size_t count) const {
+    // the pages run through the rows of the rectangle of their range
+    for_each_run(offset, count, [&](size_t x, size_t y, size_t n) {
+        pack_states(pixels + y * stride, x, states, n);
+        states += n;
+    });
+}
+
+// the position of the d-th pixel on the hilbert curve through a square with
+// a side of n, a power of two. the curve starts at (0, 0) and ends at
+// (n - 1, 0).
+static void hilbert_position(size_t n, size_t d, size_t *x, size_t *y) {
+    *x = *y = 0;
+    for (size_t s = 1; s < n; s *= 2) {
+        size_t rx = 1 & (d / 2);
+        size_t ry = 1 & (d ^ rx);
+
+        // rotate the quadrant
+        if (ry == 0) {
+            if (rx == 1) {
+                *x = s - 1 - *x;
+                *y = s - 1 - *y;
+            }
+            std::swap(*x, *y);
+        }
+
+        *x += s * rx;
+        *y += s * ry;
+        d /= 4;
+    }
+}
+
+hilbert_layout::hilbert_layout(const std::vector<range>& ranges) {
+    size_t total = 0;
+    for (const range& r : ranges) {
+        total += r.num_pages();
+    }
+
+    // the smallest square holding all pages, or two squares of half its
+    // side next to each other. as the curve ends next to where it starts in
+    // the second square, it continues without a jump.
+    unsigned bits = 1;
+    while (((size_t)1 << (2 * bits)) < total) {
+        bits++;
+    }
+    side = (size_t)1 << bits;
+    width_bits = bits;
+    if (side > 2 && (side / 2) * side >= total) {
+        side /= 2;
+    }
+
+    size_t square = side * side;
+    pixel_of_page.resize(total);
+
+    #pragma omp parallel for schedule(static)
+    for (size_t d = 0; d < total; ++d) {
+        size_t x, y;
+        hilbert_position(side, d % square, &x, &y);
+        x += (d / square) * side;
+        pixel_of_page[d] = (y << width_bits) + x;
+    }
+}
+
+void hilbert_layout::fill(unsigned char *pixels, size_t stride, size_t offset,
+                          const uint8_t *states, size_t count) const {
+    const uint32_t *pixel = pixel_of_page.data() + offset;
+    size_t mask = ((size_t)1 << width_bits) - 1;
+
+    for (size_t j = 0; j < count; ++j) {
+        set_pixel(pixels + (pixel[j] >> width_bits) * stride, pixel[j] & mask,
+                  PIXEL_STATE(states[j]));
+    }
+}
+
+std::unique_ptr<page_layout> make_page_layout(const std::vector<range>& ranges,
+                                              enum frame_layout layout) {
+    if (layout == LAYOUT_HILBERT) {
+        size_t total = 0;
+        for (const range& r : ranges) {
+            total += r.num_pages();
+        }
+
+        // beyond 2^32 pages the curve needs more pixels than the table of
+        // the hilbert layout can number
+        if (total <= UINT32_MAX) {
+            return std::unique_ptr<page_layout>(new hilbert_layout(ranges));
+        }
+        std::cerr << "warning: " << total << " pages are too many for the hilbert curve "
+                  << "layout, using the treemap layout" << std::endl;
+    }
+    return std::unique_ptr<page_layout>(new treemap_layout(ranges));
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2022 - 2023 OSM Group @ HPI, University of Potsdam
+ */
+
+#ifndef LAYOUT_H_
+#define LAYOUT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "./range.h"
+#include "./smog-trace-converter.h"
+
+// places the pages of the compacted address space on the pixels of a
+// frame image. the placement only depends on the aggregated ranges, so it
+// is computed once and shared by all frames.
+class page_layout {
+ public:
+    virtual ~page_layout() {}
+
+    virtual size_t width() const = 0;
+    virtual size_t height() const = 0;
+
+    // draw the states of count consecutive pages, starting at offset in the
+    // compacted address space and lying within a single range, into an
+    // image of packed pixels with rows stride bytes apart
+    virtual void fill(unsigned char *pixels, size_t stride, size_t offset,
+                      const uint8_t *states, size_t count) const = 0;
+};
+
+// create the layout chosen on the command line
+std::unique_ptr<page_layout> make_page_layout(const std::vector<range>& ranges,
+                                              enum frame_layout layout);
+
+// a rectangle of pixels holding the pages of a range, filled row by row
+struct layout_rect {
+    size_t x;
+    size_t y;
+    size_t width;
+    size_t height;
+
+    // the first page of the range in the compacted address space
+    size_t offset;
+    size_t pages;
+};
+
+// places the ranges of the address space in a squarified treemap, so that
+// every range is a rectangle with an area proportional to its size and an
+// aspect ratio close to 1.
+// see https://www.win.tue.nl/~vanwijk/stm.pdf
+class treemap_layout : public page_layout {
+ public:
+    explicit treemap_layout(const std::vector<range>& ranges);
+
+    size_t width() const override { return xres; }
+    size_t height() const override { return yres; }
+
+    void fill(unsigned char *pixels, size_t stride, size_t offset,
+              const uint8_t *states, size_t count) const override;
+
+    // the rectangle of the range holding the page at offset in the compacted
+    // address space
+    const layout_rect& rect_of(size_t offset) const {
+        auto it = std::upper_bound(offsets.begin(), offsets.end(), offset);
+        return rects[std::max<ptrdiff_t>(it - offsets.begin() - 1, 0)];
+    }
+
+    // call fn(x, y, count) for the runs of pixels that count consecutive
+    // pages, starting at offset and lying within a single range, occupy
+    template<typename Fn>
+    void for_each_run(size_t offset, size_t count, Fn fn) const {
+        const layout_rect& rect = rect_of(offset);
+
+        size_t page = offset - rect.offset;
+        count = std::min(count, rect.pages > page ? rect.pages - page : 0);
+
+        while (count) {
+            size_t x = page % rect.width;
+            size_t n = std::min(count, rect.width - x);
+            fn(rect.x + x, rect.y + page / rect.width, n);
+            page += n;
+            count -= n;
+        }
+    }
+
+ private:
+    bool place(const std::vector<range>& ranges, double scale);
+
+    size_t xres;
+    size_t yres;
+
+    // sorted by offset
+    std::vector<layout_rect> rects;
+    std::vector<size_t> offsets;
+};
+
+// places the pages along a hilbert curve, so that pages close in the address
+// space stay close in the image and runs of equal states form compact
+// blobs. the curve fills one or two squares with a side of a power of two,
+// the position of every page is looked up in a precomputed table.
+class hilbert_layout : public page_layout {
+ public:
+    explicit hilbert_layout(const std::vector<range>& ranges);
+
+    size_t width() const override { return (size_t)1 << width_bits; }
+    size_t height() const override { return side; }
+
+    void fill(unsigned char *pixels, size_t stride, size_t offset,
+              const uint8_t *states, size_t count) const override;
+
+ private:
+    size_t side;
+    unsigned width_bits;
+
+    // the pixel of every page, as y * width + x. make_page_layout only
+    // creates the layout for up to 2^32 pages, so that the numbers fit.
+    std::vector<uint32_t> pixel_of_page;
+};
+
+#endif  // LAYOUT_H_
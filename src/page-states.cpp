@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2022 - 2023 OSM Group @ HPI, University of Potsdam
+ */
+
+#include "./page-states.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#define TARGET_DEFAULT __attribute__((target("default")))
+#else
+#define TARGET_DEFAULT
+#endif
+
+// decode the remaining pages one word at a time. the last word of a VMA may
+// be partially filled, so it must not be expanded beyond the page count.
+static inline void decode_tail(const uint32_t *words, size_t pages, uint8_t *states) {
+    size_t full = pages / 16;
+    for (size_t i = 0; i < full; ++i) {
+        uint32_t word;
+        memcpy(&word, words + i, sizeof(word));
+        decode_page_word(word, states + i * 16);
+    }
+
+    if (pages % 16) {
+        uint8_t last[16];
+        uint32_t word;
+        memcpy(&word, words + full, sizeof(word));
+        decode_page_word(word, last);
+        memcpy(states + full * 16, last, pages % 16);
+    }
+}
+
+TARGET_DEFAULT
+static void decode_states(const uint32_t *words, size_t pages, uint8_t *states) {
+    decode_tail(words, pages, states);
+}
+
+#ifdef HAVE_X86_KERNELS
+
+// every byte of packed states holds 4 pages. splitting the bytes into the 4
+// positions and interleaving them again restores the page order:
+//
+//   a0 = b & 3, a1 = (b >> 2) & 3, a2 = (b >> 4) & 3, a3 = (b >> 6) & 3
+//   unpack8(a0, a1) -> a0[0] a1[0] a0[1] a1[1] ...
+//   unpack16(.., ..) -> a0[0] a1[0] a2[0] a3[0] a0[1] ...
+//
+// the 16 bit shifts bleed bits across byte boundaries, these are masked away.
+
+__attribute__((target("sse4.1")))
+static void decode_states(const uint32_t *words, size_t pages, uint8_t *states) {
+    const __m128i mask = _mm_set1_epi8(0x3);
+
+    // 4 words, 64 pages per iteration
+    size_t i = 0;
+    for (; i + 64 <= pages; i += 64) {
+        __m128i b = _mm_loadu_si128((const __m128i*)(words + i / 16));
+
+        __m128i a0 = _mm_and_si128(b, mask);
+        __m128i a1 = _mm_and_si128(_mm_srli_epi16(b, 2), mask);
+        __m128i a2 = _mm_and_si128(_mm_srli_epi16(b, 4), mask);
+        __m128i a3 = _mm_and_si128(_mm_srli_epi16(b, 6), mask);
+
+        __m128i u01lo = _mm_unpacklo_epi8(a0, a1);
+        __m128i u01hi = _mm_unpackhi_epi8(a0, a1);
+        __m128i u23lo = _mm_unpacklo_epi8(a2, a3);
+        __m128i u23hi = _mm_unpackhi_epi8(a2, a3);
+
+        _mm_storeu_si128((__m128i*)(states + i), _mm_unpacklo_epi16(u01lo, u23lo));
+        _mm_storeu_si128((__m128i*)(states + i + 16), _mm_unpackhi_epi16(u01lo, u23lo));
+        _mm_storeu_si128((__m128i*)(states + i + 32), _mm_unpacklo_epi16(u01hi, u23hi));
+        _mm_storeu_si128((__m128i*)(states + i + 48), _mm_unpackhi_epi16(u01hi, u23hi));
+    }
+
+    decode_tail(words + i / 16, pages - i, states + i);
+}
+
+__attribute__((target("avx2")))
+static void decode_states(const uint32_t *words, size_t pages, uint8_t *states) {
+    const __m256i mask = _mm256_set1_epi8(0x3);
+
+    // 8 words, 128 pages per iteration. the unpack instructions work within
+    // 128 bit lanes, so the low lanes hold pages 0-63 and the high lanes
+    // pages 64-127, which are recombined by the final permutes.
+    size_t i = 0;
+    for (; i + 128 <= pages; i += 128) {
+        __m256i b = _mm256_loadu_si256((const __m256i*)(words + i / 16));
+
+        __m256i a0 = _mm256_and_si256(b, mask);
+        __m256i a1 = _mm256_and_si256(_mm256_srli_epi16(b, 2), mask);
+        __m256i a2 = _mm256_and_si256(_mm256_srli_epi16(b, 4), mask);
+        __m256i a3 = _mm256_and_si256(_mm256_srli_epi16(b, 6), mask);
+
+        __m256i u01lo = _mm256_unpacklo_epi8(a0, a1);
+        __m256i u01hi = _mm256_unpackhi_epi8(a0, a1);
+        __m256i u23lo = _mm256_unpacklo_epi8(a2, a3);
+        __m256i u23hi = _mm256_unpackhi_epi8(a2, a3);
+
+        __m256i q0 = _mm256_unpacklo_epi16(u01lo, u23lo);
+        __m256i q1 = _mm256_unpackhi_epi16(u01lo, u23lo);
+        __m256i q2 = _mm256_unpacklo_epi16(u01hi, u23hi);
+        __m256i q3 = _mm256_unpackhi_epi16(u01hi, u23hi);
+
+        _mm256_storeu_si256((__m256i*)(states + i), _mm256_permute2x128_si256(q0, q1, 0x20));
+        _mm256_storeu_si256((__m256i*)(states + i + 32), _mm256_permute2x128_si256(q2, q3, 0x20));
+        _mm256_storeu_si256((__m256i*)(states + i + 64), _mm256_permute2x128_si256(q0, q1, 0x31));
+        _mm256_storeu_si256((__m256i*)(states + i + 96), _mm256_permute2x128_si256(q2, q3, 0x31));
+    }
+
+    decode_tail(words + i / 16, pages - i, states + i);
+}
+
+#endif  // HAVE_X86_KERNELS
+
+void decode_page_states(const uint32_t *words, size_t pages, uint8_t *states) {
+    // dispatched through an ifunc resolved at load time
+    decode_states(words, pages, states);
+}
+
+// with lo being the low and hi the high bit of each page state
+//
+//   present:  lo | hi
+//   accessed: hi
+//   dirty:    lo & hi
+//
+// so that each count is the popcount of the respective mask over the even
+// bit positions, 32 pages per 64 bit word.
+static inline void count_word(uint64_t word, uint64_t valid, size_t *present, size_t *accessed,
+                              size_t *dirty) {
+    const uint64_t even = 0x5555555555555555ull;
+
+    uint64_t lo = word & even & valid;
+    uint64_t hi = (word >> 1) & even & valid;
+
+    *present += __builtin_popcountll(lo | hi);
+    *accessed += __builtin_popcountll(hi);
+    *dirty += __builtin_popcountll(lo & hi);
+}
+
+static inline void count_states(const uint32_t *words, size_t pages,
+                                struct page_state_counts *counts) {
+    size_t present = 0, accessed = 0, dirty = 0;
+
+    size_t i = 0;
+    for (; i + 32 <= pages; i += 32) {
+        uint64_t word;
+        memcpy(&word, words + i / 16, sizeof(word));
+        count_word(word, ~0ull, &present, &accessed, &dirty);
+    }
+
+    // the last 1 to 31 pages live in one or two trailing words
+    if (i < pages) {
+        size_t rest = pages - i;
+        uint64_t word = 0;
+        memcpy(&word, words + i / 16, trace_vma_words(rest) * 4);
+        count_word(word, (1ull << (rest * 2)) - 1, &present, &accessed, &dirty);
+    }
+
+    counts->pages = pages;
+    counts->present = present;
+    counts->accessed = accessed;
+    counts->dirty = dirty;
+}
+
+TARGET_DEFAULT
+static void count_states_dispatch(const uint32_t *words, size_t pages,
+                                  struct page_state_counts *counts) {
+    count_states(words, pages, counts);
+}
+
+#ifdef HAVE_X86_KERNELS
+
+__attribute__((target("popcnt")))
+static void count_states_dispatch(const uint32_t *words, size_t pages,
+                                  struct page_state_counts *counts) {
+    count_states(words, pages, counts);
+}
+
+#endif  // HAVE_X86_KERNELS
+
+void count_page_states(const uint32_t *words, size_t pages, struct page_state_counts *counts) {
+    // dispatched through an ifunc resolved at load time
+    count_states_dispatch(words, pages, counts);
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2022 - 2023 OSM Group @ HPI, University of Potsdam
+ */
+
+#ifndef PAGE_STATES_H_
+#define PAGE_STATES_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "./trace-iterator.h"
+
+// page states are stored with 2 bits per page, 16 pages per word:
+//
+//   0: reserved and not present
+//   1: present and not accessed
+//   2: accessed and not dirty
+//   3: dirty
+
+// the number of pages decoded at once by for_each_state_block. this is a
+// multiple of 16, so that every block starts on a word boundary.
+#define PAGE_STATE_BLOCK 4096
+
+static inline void decode_page_word(uint32_t word, uint8_t *states) {
+    for (size_t k = 0; k < 16; ++k) {
+        states[k] = (word >> (k * 2)) & 0x3;
+    }
+}
+
+// expand the packed states of pages into one byte per page. the best
+// available implementation for the CPU is selected at load time.
+void decode_page_states(const uint32_t *words, size_t pages, uint8_t *states);
+
+// per-state page totals. the states are ordered, so every count includes
+// the pages of all higher states.
+struct page_state_counts {
+    size_t pages;
+    size_t present;
+    size_t accessed;
+    size_t dirty;
+};
+
+// count the pages per state straight from the packed words using popcount,
+// without expanding individual pages.
+void count_page_states(const uint32_t *words, size_t pages, struct page_state_counts *counts);
+
+// decode the pages of a VMA block by block, calling
+// fn(size_t first_page, const uint8_t *states, size_t count) for each block
+template<typename Fn>
+void for_each_state_block(const trace_vma& vma, Fn fn) {
+    uint8_t states[PAGE_STATE_BLOCK];
+
+    size_t pages = vma.num_pages();
+    for (size_t first = 0; first < pages; first += PAGE_STATE_BLOCK) {
+        size_t count = pages - first < PAGE_STATE_BLOCK ? pages - first : PAGE_STATE_BLOCK;
+        decode_page_states(vma.words + first / 16, count, states);
+        fn(first, states, count);
+    }
+}
+
+#endif  // PAGE_STATES_H_
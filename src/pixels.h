@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2022 - 2023 OSM Group @ HPI, University of Potsdam
+ */
+
+#ifndef PIXELS_H_
+#define PIXELS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// the images are written as indexed colors with 4 bits per pixel, two
+// pixels per byte with the left pixel in the high nibble. index 0 marks
+// pixels not covered by any VMA in a frame, so that zeroed rows are empty,
+// the page states follow from index 1.
+#define PIXEL_BIT_DEPTH 4
+#define PIXEL_EMPTY 0
+#define PIXEL_STATE(state) ((state) + 1)
+#define PIXEL_PALETTE_SIZE 5
+
+// not reserved: black            (0, 0, 0)
+// reserved and not present: blue (0, 0, 1)
+// present and not accessed: cyan (0, 1, 1)
+// accessed and not dirty: green  (0, 1, 0)
+// dirty: red                     (1, 0, 0)
+// animated images draw the pixels that did not change since the previous
+// frame with an additional, fully transparent index
+#define PIXEL_TRANSPARENT PIXEL_PALETTE_SIZE
+
+static const unsigned char pixel_palette[PIXEL_PALETTE_SIZE][3] = {
+    { 0, 0, 0 },
+    { 0, 0, 255 },
+    { 0, 255, 255 },
+    { 0, 255, 0 },
+    { 255, 0, 0 },
+};
+
+// pixels colored by their fraction of dirty pages use all indices after 0 as
+// a gradient from blue, no dirty pages, to red, only dirty pages
+#define PIXEL_GRADIENT_SIZE 16
+
+static inline unsigned pixel_gradient(size_t dirty, size_t pages) {
+    return 1 + (dirty * (PIXEL_GRADIENT_SIZE - 2) + pages / 2) / pages;
+}
+
+static inline void gradient_color(unsigned index, unsigned char color[3]) {
+    unsigned level = index ? (index - 1) * 255 / (PIXEL_GRADIENT_SIZE - 2) : 0;
+    color[0] = level;
+    color[1] = 0;
+    color[2] = index ? 255 - level : 0;
+}
+
+static inline size_t pixel_row_bytes(size_t width) {
+    return (width + 1) / 2;
+}
+
+static inline void set_pixel(unsigned char *row, size_t x, unsigned value) {
+    unsigned char *byte = row + x / 2;
+    if (x % 2) {
+        *byte = (*byte & 0xf0) | value;
+    } else {
+        *byte = (*byte & 0x0f) | (value << 4);
+    }
+}
+
+static inline unsigned get_pixel(const unsigned char *row, size_t x) {
+    return (x % 2) ? (row[x / 2] & 0x0f) : (row[x / 2] >> 4);
+}
+
+// store count decoded page states as pixels of a row, starting at pixel x
+static inline void pack_states(unsigned char *row, size_t x, const uint8_t *states, size_t count) {
+    if (!count) {
+        return;
+    }
+
+    if (x % 2) {
+        set_pixel(row, x++, PIXEL_STATE(*states++));
+        count--;
+    }
+
+    unsigned char *byte = row + x / 2;
+    for (size_t j = 0; j + 1 < count; j += 2) {
+        *byte++ = (PIXEL_STATE(states[j]) << 4) | PIXEL_STATE(states[j + 1]);
+    }
+
+    if (count % 2) {
+        set_pixel(row, x + count - 1, PIXEL_STATE(states[count - 1]));
+    }
+}
+
+#endif  // PIXELS_H_
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2022 - 2023 OSM Group @ HPI, University of Potsdam
+ */
+
+#ifndef RANGE_H_
+#define RANGE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <utility>
+#include <ostream>
+#include <vector>
+
+// an inclusive range of pages
+class range {
+ public:
+    size_t lower;
+    size_t upper;
+
+    range(size_t start, size_t end) : lower(start), upper(end) {
+        assert(upper >= lower);
+    }
+
+    size_t num_pages() const {
+        return upper - lower + 1;
+    }
+
+    bool intersects(range const& b) const {
+        return this->lower <= b.upper && b.lower <= this->upper;
+    }
+
+    bool operator==(range const& b) const {
+        return b.lower == lower && b.upper == upper;
+    }
+
+    bool operator!=(range const& b) const {
+        return b.lower != lower || b.upper != upper;
+    }
+
+    bool operator>(range const& b) const {
+        return lower > b.upper;
+    }
+
+    bool operator<(range const& b) const {
+        return upper < b.lower;
+    }
+
+    range operator&(range b) {
+        size_t l = std::max(b.lower, lower);
+        size_t r = std::min(b.upper, upper);
+        if (r < l) {
+            return range(0, 0);
+        } else {
+            return range(l, r);
+        }
+    }
+
+    range operator|(range b) {
+        size_t l = std::min(b.lower, lower);
+        size_t r = std::max(b.upper, upper);
+        return range(l, r);
+    }
+
+    range& operator|=(range b) {
+        *this = *this | b;
+        return *this;
+    }
+
+    friend std::ostream& operator<<(std::ostream &os, const range &r) {
+        os << std::hex << "(0x" << r.lower << ", 0x" << r.upper << ")" << std::dec;
+        return os;
+    }
+};
+
+// a set of disjoint, non-adjacent ranges, keyed by their lower bound.
+// inserting a range coalesces it with every overlapping or adjacent range
+// in O(log n) plus the number of ranges absorbed.
+class range_set {
+ public:
+    void insert(range r) {
+        auto it = bounds.upper_bound(r.lower);
+
+        // absorb a predecessor that overlaps or touches the range
+        if (it != bounds.begin()) {
+            auto prev = std::prev(it);
+            if (r.lower == 0 || prev->second >= r.lower - 1) {
+                r.lower = prev->first;
+                r.upper = std::max(r.upper, prev->second);
+                bounds.erase(prev);
+            }
+        }
+
+        // absorb all successors that overlap or touch the range
+        while (it != bounds.end() && (r.upper == SIZE_MAX || it->first <= r.upper + 1)) {
+            r.upper = std::max(r.upper, it->second);
+            it = bounds.erase(it);
+        }
+
+        bounds.emplace_hint(it, r.lower, r.upper);
+    }
+
+    // merge the ranges of other into this set, leaving other empty. the
+    // smaller of both sets is inserted into the larger one.
+    void merge(range_set& other) {
+        if (other.bounds.size() > bounds.size()) {
+            std::swap(bounds, other.bounds);
+        }
+
+        for (const auto& bound : other.bounds) {
+            insert(range(bound.first, bound.second));
+        }
+        other.bounds.clear();
+    }
+
+    size_t size() const {
+        return bounds.size();
+    }
+
+    bool empty() const {
+        return bounds.empty();
+    }
+
+    size_t num_pages() const {
+        size_t pages = 0;
+        for (const auto& bound : bounds) {
+            pages += bound.second - bound.first + 1;
+        }
+        return pages;
+    }
+
+    // the ranges in ascending order
+    std::vector<range> ranges() const {
+        std::vector<range> result;
+        result.reserve(bounds.size());
+        for (const auto& bound : bounds) {
+            result.emplace_back(bound.first, bound.second);
+        }
+        return result;
+    }
+
+ private:
+    std::map<size_t, size_t> bounds;
+};
+
+// maps page numbers into the compacted address space formed by a sorted
+// list of disjoint ranges. the offset of each range is precomputed as a
+// prefix sum, so a lookup is a branchless binary search over the lower
+// bounds instead of a walk over all preceding ranges.
+class range_index {
+ public:
+    explicit range_index(const std::vector<range>& ranges) {
+        lowers.reserve(ranges.size());
+        uppers.reserve(ranges.size());
+        offsets.reserve(ranges.size() + 1);
+
+        size_t offset = 0;
+        for (const range& r : ranges) {
+            lowers.push_back(r.lower);
+            uppers.push_back(r.upper);
+            offsets.push_back(offset);
+            offset += r.num_pages();
+        }
+        offsets.push_back(offset);
+    }
+
+    // the offset of a page. pages between ranges map to the start of the
+    // next range, pages beyond the last range map to the end.
+    size_t offset(size_t page) const {
+        size_t n = lowers.size();
+        if (!n || page < lowers[0]) {
+            return 0;
+        }
+
+        // find the last range starting at or below the page
+        const size_t *base = lowers.data();
+        while (n > 1) {
+            size_t half = n / 2;
+            base = (base[half] <= page) ? base + half : base;
+            n -= half;
+        }
+
+        size_t i = base - lowers.data();
+        if (page > uppers[i]) {
+            return offsets[i + 1];
+        }
+        return offsets[i] + (page - lowers[i]);
+    }
+
+    // the total number of pages in all ranges
+    size_t num_pages() const {
+        return offsets.back();
+    }
+
+ private:
+    std::vector<size_t> lowers;
+    std::vector<size_t> uppers;
+    std::vector<size_t> offsets;
+};
+
+#endif  // RANGE_H_
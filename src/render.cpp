@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2022 - 2023 OSM Group @ HPI, University of Potsdam
+ */
+
+#include "./render.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <vector>
+
+#include <png.h>
+
+#include "./page-states.h"
+#include "./pixels.h"
+#include "./aggregate.h"
+#include "./smog-trace-converter.h"
+
+static bool vma_filtered(const trace_vma& vma) {
+    return arguments.filter_vma && vma.name != arguments.filter_vma;
+}
+
+range_set aggregate_vma_ranges(struct smog_tracefile *tracefile, size_t step) {
+    return aggregate_frames<range_set>((tracefile->num_frames + step - 1) / step,
+        [&](range_set& local, size_t i) {
+            // extend the set of ranges by each VMA
+            for (const trace_vma& vma : trace_frame(tracefile, i * step)) {
+                if (arguments.verbose > 3) {
+                    printf("considering range (%#zx, %#zx) :: %.*s\n", vma.start, vma.end,
+                           (int)vma.name.size(), vma.name.data());
+                }
+
+                // skip VMA if filtered out
+                if (vma_filtered(vma)) {
+                    continue;
+                }
+
+                // insert VMA into active ranges, skipping empty ones
+                if (vma.end <= vma.start) {
+                    continue;
+                }
+
+                local.insert(range(vma.start, vma.end - 1));
+            }
+        },
+        [](range_set& into, range_set& from) {
+            into.merge(from);
+        });
+}
+
+void render_frame_row(unsigned char *row, const range_index& index, size_t width,
+                      trace_frame frame) {
+    for (const trace_vma& vma : frame) {
+        if (vma_filtered(vma)) {
+            continue;
+        }
+
+        size_t pixel_offset = index.offset(vma.start);
+
+        size_t pages = vma.num_pages();
+        if (pixel_offset + pages > width) {
+            fprintf(stderr, "warning: pixel position out of range\n");
+            pages = pixel_offset < width ? width - pixel_offset : 0;
+        }
+
+        for_each_state_block(vma, [&](size_t first, const uint8_t *states, size_t count) {
+            if (first + count > pages) {
+                count = first < pages ? pages - first : 0;
+            }
+
+            pack_states(row, pixel_offset + first, states, count);
+        });
+    }
+}
+
+void render_frame_layout(unsigned char *pixels, size_t stride, const range_index& index,
+                         const page_layout& layout, trace_frame frame) {
+    for (const trace_vma& vma : frame) {
+        if (vma_filtered(vma) || vma.end <= vma.start) {
+            continue;
+        }
+
+        size_t page_offset = index.offset(vma.start);
+
+        for_each_state_block(vma, [&](size_t first, const uint8_t *states, size_t count) {
+            layout.fill(pixels, stride, page_offset + first, states, count);
+        });
+    }
+}
+
+row_renderer::row_renderer(struct smog_tracefile *tracefile, const range_index& index,
+                           size_t max_width, size_t max_height,
+                           enum pixel_reduction reduction, bool sampled)
+        : tracefile(tracefile), index(index), reduction(reduction), sampled(sampled) {
+    size_t pages = index.num_pages();
+    size_t frames = tracefile->num_frames;
+
+    bin_pages = bin_size(pages, max_width);
+    bin_frames = bin_size(frames, max_height);
+    xres = (pages + bin_pages - 1) / bin_pages;
+    yres = (frames + bin_frames - 1) / bin_frames;
+}
+
+size_t row_renderer::palette(unsigned char colors[][3]) const {
+    if (binned() && !sampled && reduction == REDUCE_DIRTY) {
+        for (unsigned i = 0; i < PIXEL_GRADIENT_SIZE; ++i) {
+            gradient_color(i, colors[i]);
+        }
+        return PIXEL_GRADIENT_SIZE;
+    }
+
+    memcpy(colors, pixel_palette, sizeof(pixel_palette));
+    return PIXEL_PALETTE_SIZE;
+}
+
+void row_renderer::render(unsigned char *row, size_t y) const {
+    if (!binned()) {
+        render_frame_row(row, index, xres, trace_frame(tracefile, y));
+        return;
+    }
+
+    if (sampled) {
+        render_sampled(row, y);
+        return;
+    }
+
+    size_t first_frame = y * bin_frames;
+    size_t frames = std::min(bin_frames, (size_t)tracefile->num_frames - first_frame);
+    size_t total_pages = index.num_pages();
+
+    // the number of pages in each state, per pixel
+    std::vector<size_t> counts(xres * 4);
+
+    for (size_t f = first_frame; f < first_frame + frames; ++f) {
+        for (const trace_vma& vma : trace_frame(tracefile, f)) {
+            if (vma_filtered(vma)) {
+                continue;
+            }
+
+            size_t page_offset = index.offset(vma.start);
+
+            size_t pages = vma.num_pages();
+            if (page_offset + pages > total_pages) {
+                fprintf(stderr, "warning: pixel position out of range\n");
+                pages = page_offset < total_pages ? total_pages - page_offset : 0;
+            }
+
+            for_each_state_block(vma, [&](size_t first, const uint8_t *states, size_t count) {
+                if (first + count > pages) {
+                    count = first < pages ? pages - first : 0;
+                }
+
+                // count the states in runs of pages falling into the same bin
+                size_t page = page_offset + first;
+                for (size_t j = 0; j < count;) {
+                    size_t pixel = page / bin_pages;
+                    size_t run = std::min(count - j, (pixel + 1) * bin_pages - page);
+                    size_t *bin = &counts[pixel * 4];
+                    for (size_t k = 0; k < run; ++k) {
+                        bin[states[j + k]]++;
+                    }
+                    j += run;
+                    page += run;
+                }
+            });
+        }
+    }
+
+    for (size_t x = 0; x < xres; ++x) {
+        const size_t *bin = &counts[x * 4];
+        size_t covered = bin[0] + bin[1] + bin[2] + bin[3];
+
+        unsigned value = PIXEL_EMPTY;
+        switch (reduction) {
+            case REDUCE_MAX:
+                for (unsigned state = 0; state < 4; ++state) {
+                    if (bin[state]) {
+                        value = PIXEL_STATE(state);
+                    }
+                }
+                break;
+            case REDUCE_DIRTY:
+                if (covered) {
+                    value = pixel_gradient(bin[3], covered);
+                }
+                break;
+            case REDUCE_MAJORITY: {
+                // the cells of the bin not covered by any VMA count as empty,
+                // ties go to the more active state. overlapping VMAs may
+                // cover cells more than once.
+                size_t cells = std::min(bin_pages, total_pages - x * bin_pages) * frames;
+                size_t most = covered < cells ? cells - covered : 0;
+                for (unsigned state = 0; state < 4; ++state) {
+                    if (bin[state] && bin[state] >= most) {
+                        value = PIXEL_STATE(state);
+                        most = bin[state];
+                    }
+                }
+                break;
+            }
+        }
+
+        set_pixel(row, x, value);
+    }
+}
+
+void row_renderer::render_sampled(unsigned char *row, size_t y) const {
+    size_t total_pages = index.num_pages();
+
+    for (const trace_vma& vma : trace_frame(tracefile, y * bin_frames)) {
+        if (vma_filtered(vma)) {
+            continue;
+        }
+
+        size_t page_offset = index.offset(vma.start);
+        size_t end = std::min(page_offset + vma.num_pages(), total_pages);
+
+        // decode only the pages sampled by the pixels within the VMA
+        for (size_t x = (page_offset + bin_pages - 1) / bin_pages; x * bin_pages < end; ++x) {
+            set_pixel(row, x, PIXEL_STATE(vma.state(x * bin_pages - page_offset)));
+        }
+    }
+}
+
+int write_palette_png(const char *path, size_t width, size_t height,
+                      unsigned char *const *rows) {
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!png) {
+        fprintf(stderr, "%s: png_create_write_struct: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    png_infop png_info = png_create_info_struct(png);
+    if (!png_info) {
+        fprintf(stderr, "%s: png_create_info_struct: %s\n", path, strerror(errno));
+        png_destroy_write_struct(&png, NULL);
+        return 1;
+    }
+
+    FILE *png_fp = fopen(path, "wb");
+    if (png_fp == NULL) {
+        fprintf(stderr, "%s: fopen: %s\n", path, strerror(errno));
+        png_destroy_write_struct(&png, &png_info);
+        return 1;
+    }
+
+    png_init_io(png, png_fp);
+    png_set_IHDR(png,
+                 png_info,
+                 width,
+                 height,
+                 PIXEL_BIT_DEPTH,
+                 PNG_COLOR_TYPE_PALETTE,
+                 PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_BASE,
+                 PNG_FILTER_TYPE_BASE);
+
+    png_color palette[PIXEL_PALETTE_SIZE];
+    for (size_t i = 0; i < PIXEL_PALETTE_SIZE; ++i) {
+        palette[i].red = pixel_palette[i][0];
+        palette[i].green = pixel_palette[i][1];
+        palette[i].blue = pixel_palette[i][2];
+    }
+
+    png_set_PLTE(png, png_info, palette, PIXEL_PALETTE_SIZE);
+    png_write_info(png, png_info);
+    png_write_image(png, const_cast<png_bytepp>(rows));
+    png_write_end(png, png_info);
+
+    png_destroy_write_struct(&png, &png_info);
+
+    if (fclose(png_fp) != 0) {
+        fprintf(stderr, "%s: fclose: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2022 - 2023 OSM Group @ HPI, University of Potsdam
+ */
+
+#ifndef RENDER_H_
+#define RENDER_H_
+
+#include <cstddef>
+
+#include "./tracefile.h"
+#include "./trace-iterator.h"
+#include "./range.h"
+#include "./layout.h"
+#include "./smog-trace-converter.h"
+
+// the number of items per bin when fitting count items into at most max bins,
+// where a max of 0 means no limit
+static inline size_t bin_size(size_t count, size_t max) {
+    return (max && count > max) ? (count + max - 1) / max : 1;
+}
+
+// aggregate the address ranges of all VMAs in the trace that pass the VMA
+// filter given on the command line, considering only every step-th frame
+range_set aggregate_vma_ranges(struct smog_tracefile *tracefile, size_t step = 1);
+
+// render the pages of a frame into a row of pixels, one pixel per page in
+// the address space compacted by index
+void render_frame_row(unsigned char *row, const range_index& index, size_t width,
+                      trace_frame frame);
+
+// render the pages of a frame into the pixels the layout places them on.
+// the rows of the image are stride bytes apart.
+void render_frame_layout(unsigned char *pixels, size_t stride, const range_index& index,
+                         const page_layout& layout, trace_frame frame);
+
+// renders the rows of an image of the whole trace. by default every row
+// shows a frame and every pixel a page. when the image is limited in size,
+// every pixel covers a bin of consecutive pages and frames instead, and the
+// page states are reduced into the bins while they are decoded, so that the
+// full resolution image never exists. a sampled renderer only reads the
+// first frame of each bin and the first page of each bin within it.
+class row_renderer {
+ public:
+    row_renderer(struct smog_tracefile *tracefile, const range_index& index,
+                 size_t max_width, size_t max_height, enum pixel_reduction reduction,
+                 bool sampled = false);
+
+    size_t width() const { return xres; }
+    size_t height() const { return yres; }
+    size_t pages_per_pixel() const { return bin_pages; }
+    size_t frames_per_pixel() const { return bin_frames; }
+
+    // fill the palette used by the rendered pixels, returning its size
+    size_t palette(unsigned char colors[][3]) const;
+
+    // render row y into a zeroed row of packed pixels. safe to call from
+    // multiple threads.
+    void render(unsigned char *row, size_t y) const;
+
+ private:
+    bool binned() const { return bin_pages > 1 || bin_frames > 1; }
+
+    void render_sampled(unsigned char *row, size_t y) const;
+
+    struct smog_tracefile *tracefile;
+    const range_index& index;
+    enum pixel_reduction reduction;
+    bool sampled;
+    size_t bin_pages;
+    size_t bin_frames;
+    size_t xres;
+    size_t yres;
+};
+
+// write an image of packed pixels to a png file
+int write_palette_png(const char *path, size_t width, size_t height,
+                      unsigned char *const *rows);
+
+#endif  // RENDER_H_
@@ -4,6 +4,8 @@
 
 #include "./smog-trace-converter.h"
 
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/mman.h>
 
@@ -13,9 +15,14 @@
 #include "./backends/png.h"
 #include "./backends/png-frames.h"
 #include "./backends/histogram.h"
+#include "./backends/summary.h"
+#include "./backends/tiles.h"
+#include "./backends/apng.h"
 
 // defaults for cli arguments
-struct arguments arguments = { NULL, NULL, NULL, 0, OUTPUT_UNKNOWN, 0 };
+struct arguments arguments = { NULL, NULL, NULL, NULL, 0, 0, 0, OUTPUT_UNKNOWN,
+                               PNG_ENCODER_BUFFERED, REDUCE_MAX, DEDUP_NONE, LAYOUT_TREEMAP,
+                               0, 0, 0 };
 
 static const char *output_format_to_string(enum output_format format) {
     switch (format) {
@@ -27,6 +34,16 @@ static const char *output_format_to_string(enum output_format format) {
             return "png-frames";
         case OUTPUT_HISTOGRAM:
             return "histogram";
+        case OUTPUT_SUMMARY:
+            return "summary";
+        case OUTPUT_TILES:
+            return "tiles";
+        case OUTPUT_APNG:
+            return "apng";
+        case OUTPUT_HISTOGRAM_BINARY:
+            return "histogram-bin";
+        case OUTPUT_HISTOGRAM_PARQUET:
+            return "histogram-parquet";
         default:
             return "unknown";
     }
@@ -54,12 +71,34 @@ int main(int argc, char *argv[]) {
 
     printf("Indexing frame offsets:   ");
     fflush(stdout);
-    res = tracefile_index_frames(&tracefile);
-    if (res != 0) {
-        perror("error");
-        return 1;
+
+    char *index_path = NULL;
+    if (!arguments.no_index) {
+        size_t len = strlen(arguments.tracefile) + 5;
+        index_path = malloc(len);
+        if (!index_path) {
+            perror("malloc");
+            return 1;
+        }
+        snprintf(index_path, len, "%s.idx", arguments.tracefile);
     }
-    printf("found %zu frames\n", tracefile.num_frames);
+
+    if (index_path && tracefile_load_index(&tracefile, index_path) == 0) {
+        printf("found %zu frames (from %s)\n", tracefile.num_frames, index_path);
+    } else {
+        res = tracefile_index_frames(&tracefile);
+        if (res != 0) {
+            perror("error");
+            return 1;
+        }
+        printf("found %zu frames\n", tracefile.num_frames);
+
+        if (index_path && tracefile_save_index(&tracefile, index_path) != 0) {
+            fprintf(stderr, "warning: unable to store frame index, continuing without.\n");
+        }
+    }
+    free(index_path);
+
     if (arguments.verbose > 1) {
         for (size_t i = 0; i < tracefile.num_frames; ++i) {
             printf("  #%zu: %#zx\n", i, tracefile.frame_offsets[i]);
@@ -77,8 +116,19 @@ int main(int argc, char *argv[]) {
             res = backend_png_frames(&tracefile, arguments.output_file);
             break;
         case OUTPUT_HISTOGRAM:
+        case OUTPUT_HISTOGRAM_BINARY:
+        case OUTPUT_HISTOGRAM_PARQUET:
             res = backend_histogram(&tracefile, arguments.output_file);
             break;
+        case OUTPUT_SUMMARY:
+            res = backend_summary(&tracefile, arguments.output_file);
+            break;
+        case OUTPUT_TILES:
+            res = backend_tiles(&tracefile, arguments.output_file);
+            break;
+        case OUTPUT_APNG:
+            res = backend_apng(&tracefile, arguments.output_file);
+            break;
         default:
             fprintf(stderr, "Encountered unsupported output format. This should not happen.\n");
             return 1;
@@ -13,14 +13,51 @@ enum output_format {
     OUTPUT_PNG,
     OUTPUT_PNG_FRAMES,
     OUTPUT_HISTOGRAM,
+    OUTPUT_SUMMARY,
+    OUTPUT_TILES,
+    OUTPUT_APNG,
+    OUTPUT_HISTOGRAM_BINARY,
+    OUTPUT_HISTOGRAM_PARQUET,
+};
+
+enum png_encoder {
+    PNG_ENCODER_BUFFERED,
+    PNG_ENCODER_STREAMING,
+    PNG_ENCODER_PARALLEL,
+};
+
+enum pixel_reduction {
+    REDUCE_MAX,
+    REDUCE_DIRTY,
+    REDUCE_MAJORITY,
+};
+
+enum frame_dedup {
+    DEDUP_NONE,
+    DEDUP_SKIP,
+    DEDUP_LINK,
+};
+
+enum frame_layout {
+    LAYOUT_TREEMAP,
+    LAYOUT_HILBERT,
 };
 
 struct arguments {
     const char *tracefile;
     const char *output_file;
     const char *filter_vma;
+    const char *scratch_dir;
     int verbose;
+    int no_index;
+    int preview;
     enum output_format output_format;
+    enum png_encoder png_encoder;
+    enum pixel_reduction reduction;
+    enum frame_dedup dedup;
+    enum frame_layout layout;
+    size_t max_width;
+    size_t max_height;
     size_t page_size;
 };
 
@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2022 - 2023 OSM Group @ HPI, University of Potsdam
+ */
+
+#include "./state-planes.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#define TARGET_DEFAULT __attribute__((target("default")))
+#else
+#define TARGET_DEFAULT
+#endif
+
+// the number of limbs added at once, 4096 pages
+#define STATE_PLANES_BLOCK_LIMBS 64
+
+// the staged masks of a block span one limb more than the block, and the
+// high half of a shifted mask may reach one further
+#define STATE_PLANES_MASK_STRIDE (STATE_PLANES_BLOCK_LIMBS + 2)
+
+// add the masks of n limbs into the bits planes of a state, the planes are
+// stride limbs apart. each limb adds 64 independent one bit counters, the
+// carries ripple up through the planes until none are left.
+static inline void add_state_masks(uint64_t *planes, size_t stride, unsigned bits,
+                                   const uint64_t *masks, size_t n) {
+    for (size_t l = 0; l < n; ++l) {
+        uint64_t carry = masks[l];
+        for (unsigned b = 0; carry && b < bits; ++b) {
+            uint64_t *plane = planes + b * stride + l;
+            uint64_t next = *plane & carry;
+            *plane ^= carry;
+            carry = next;
+        }
+    }
+}
+
+#ifdef __SSE2__
+
+// split the packed states of 64 pages into masks of their low and high bits.
+// the low and high bits of the 4 pages of each byte are gathered into a
+// nibble each, the nibbles of two bytes into a byte, and the bytes of all
+// low and all high bits packed into a word each.
+static inline void split_states(const uint64_t *x, uint64_t *lo, uint64_t *hi) {
+    __m128i v = _mm_loadu_si128((const __m128i*)x);
+    const __m128i even = _mm_set1_epi8(0x55);
+    const __m128i pairs = _mm_set1_epi8(0x33);
+    const __m128i nibbles = _mm_set1_epi8(0x0f);
+    const __m128i bytes = _mm_set1_epi16(0x00ff);
+
+    __m128i l = _mm_and_si128(v, even);
+    __m128i h = _mm_and_si128(_mm_srli_epi16(v, 1), even);
+    l = _mm_and_si128(_mm_or_si128(l, _mm_srli_epi16(l, 1)), pairs);
+    h = _mm_and_si128(_mm_or_si128(h, _mm_srli_epi16(h, 1)), pairs);
+    l = _mm_and_si128(_mm_or_si128(l, _mm_srli_epi16(l, 2)), nibbles);
+    h = _mm_and_si128(_mm_or_si128(h, _mm_srli_epi16(h, 2)), nibbles);
+    l = _mm_and_si128(_mm_or_si128(l, _mm_srli_epi16(l, 4)), bytes);
+    h = _mm_and_si128(_mm_or_si128(h, _mm_srli_epi16(h, 4)), bytes);
+
+    uint64_t masks[2];
+    _mm_storeu_si128((__m128i*)masks, _mm_packus_epi16(l, h));
+    *lo = masks[0];
+    *hi = masks[1];
+}
+
+#else
+
+// gather the even bits of a word into its low half
+static inline uint64_t even_bits(uint64_t x) {
+    x &= 0x5555555555555555ull;
+    x = (x | (x >> 1)) & 0x3333333333333333ull;
+    x = (x | (x >> 2)) & 0x0f0f0f0f0f0f0f0full;
+    x = (x | (x >> 4)) & 0x00ff00ff00ff00ffull;
+    x = (x | (x >> 8)) & 0x0000ffff0000ffffull;
+    x = (x | (x >> 16)) & 0x00000000ffffffffull;
+    return x;
+}
+
+// split the packed states of 64 pages into masks of their low and high bits
+static inline void split_states(const uint64_t *x, uint64_t *lo, uint64_t *hi) {
+    *lo = even_bits(x[0]) | even_bits(x[1]) << 32;
+    *hi = even_bits(x[0] >> 1) | even_bits(x[1] >> 1) << 32;
+}
+
+#endif  // __SSE2__
+
+// stage the masks of the pages of a block in each state, 64 pages at a time.
+// the pages from first to last in words are placed at bit origin + first of
+// the planes, the first limb of the masks being first_limb.
+static inline void stage_masks(const uint32_t *words, size_t skip, size_t first, size_t last,
+                               size_t origin, size_t first_limb, uint64_t *masks) {
+    for (size_t q = first; q < last; q += 64) {
+        size_t valid_pages = last - q < 64 ? last - q : 64;
+
+        // the last word of a VMA may be the last in the trace, so words
+        // beyond the pages are not read
+        uint64_t x[2] = { 0, 0 };
+        if (valid_pages == 64) {
+            memcpy(x, words + q / 16, sizeof(x));
+        } else {
+            memcpy(x, words + q / 16, (valid_pages + 15) / 16 * sizeof(uint32_t));
+        }
+
+        uint64_t lo, hi;
+        split_states(x, &lo, &hi);
+
+        uint64_t valid = valid_pages < 64 ? (1ull << valid_pages) - 1 : ~0ull;
+        if (q < skip) {
+            valid &= ~0ull << (skip - q);
+        }
+        lo &= valid;
+        hi &= valid;
+
+        // present: lo | hi, accessed: hi, dirty: lo & hi
+        uint64_t state[STATE_PLANES_STATES] = { lo | hi, hi, lo & hi };
+
+        size_t limb = (origin + q) / 64 - first_limb;
+        unsigned shift = (origin + q) % 64;
+        for (size_t s = 0; s < STATE_PLANES_STATES; ++s) {
+            uint64_t *mask = masks + s * STATE_PLANES_MASK_STRIDE + limb;
+            mask[0] |= state[s] << shift;
+            if (shift) {
+                mask[1] |= state[s] >> (64 - shift);
+            }
+        }
+    }
+}
+
+TARGET_DEFAULT
+static void add_block(uint64_t *planes, size_t limbs, unsigned bits, const uint32_t *words,
+                      size_t skip, size_t first, size_t last, size_t origin, size_t first_limb,
+                      size_t n, uint64_t *masks) {
+    stage_masks(words, skip, first, last, origin, first_limb, masks);
+
+    for (size_t s = 0; s < STATE_PLANES_STATES; ++s) {
+        add_state_masks(planes + s * bits * limbs + first_limb, limbs, bits,
+                        masks + s * STATE_PLANES_MASK_STRIDE, n);
+    }
+}
+
+// without wide registers, adding the masks takes longer than decoding the
+// states into bytes and counting those
+TARGET_DEFAULT
+static bool add_block_accelerated() {
+    return false;
+}
+
+#ifdef HAVE_X86_KERNELS
+
+// 4 limbs, 256 pages per addition
+__attribute__((target("avx2")))
+static void add_block(uint64_t *planes, size_t limbs, unsigned bits, const uint32_t *words,
+                      size_t skip, size_t first, size_t last, size_t origin, size_t first_limb,
+                      size_t n, uint64_t *masks) {
+    stage_masks(words, skip, first, last, origin, first_limb, masks);
+
+    for (size_t s = 0; s < STATE_PLANES_STATES; ++s) {
+        uint64_t *state_plane = planes + s * bits * limbs + first_limb;
+        const uint64_t *state_masks = masks + s * STATE_PLANES_MASK_STRIDE;
+
+        size_t l = 0;
+        for (; l + 4 <= n; l += 4) {
+            __m256i carry = _mm256_loadu_si256((const __m256i*)(state_masks + l));
+            for (unsigned b = 0; b < bits && !_mm256_testz_si256(carry, carry); ++b) {
+                __m256i *plane = (__m256i*)(state_plane + b * limbs + l);
+                __m256i value = _mm256_loadu_si256(plane);
+                _mm256_storeu_si256(plane, _mm256_xor_si256(value, carry));
+                carry = _mm256_and_si256(value, carry);
+            }
+        }
+
+        add_state_masks(state_plane + l, limbs, bits, state_masks + l, n - l);
+    }
+}
+
+__attribute__((target("avx2")))
+static bool add_block_accelerated() {
+    return true;
+}
+
+#endif  // HAVE_X86_KERNELS
+
+bool state_planes::accelerated() {
+    // dispatched through an ifunc resolved at load time
+    return add_block_accelerated();
+}
+
+state_planes::state_planes(size_t pages, size_t max_count)
+        : pages(pages), limbs((pages + 63) / 64 + 1), bits(1),
+          masks(STATE_PLANES_STATES * STATE_PLANES_MASK_STRIDE) {
+    while (bits < 64 && (max_count >> bits)) {
+        bits++;
+    }
+    planes.resize(STATE_PLANES_STATES * bits * limbs);
+}
+
+void state_planes::add(const uint32_t *words, size_t skip, size_t count, size_t page) {
+    // the bit position of the first page in words, behind the padding limb
+    size_t origin = page + 64 - skip;
+    size_t end = skip + count;
+
+    for (size_t first = 0; first < end; first += STATE_PLANES_BLOCK_LIMBS * 64) {
+        size_t last = end - first < STATE_PLANES_BLOCK_LIMBS * 64
+                      ? end : first + STATE_PLANES_BLOCK_LIMBS * 64;
+        size_t first_limb = (origin + first) / 64;
+        size_t n = (origin + last - 1) / 64 - first_limb + 1;
+
+        memset(masks.data(), 0, masks.size() * sizeof(uint64_t));
+
+        // dispatched through an ifunc resolved at load time
+        add_block(planes.data(), limbs, bits, words, skip, first, last, origin, first_limb, n,
+                  masks.data());
+    }
+}
+
+void state_planes::merge(const state_planes& other) {
+    // a ripple carry addition of whole limbs, bit plane by bit plane
+    for (size_t s = 0; s < STATE_PLANES_STATES; ++s) {
+        for (size_t l = 0; l < limbs; ++l) {
+            uint64_t carry = 0;
+            for (unsigned b = 0; b < bits; ++b) {
+                uint64_t *plane = &planes[(s * bits + b) * limbs + l];
+                uint64_t addend = other.planes[(s * bits + b) * limbs + l];
+
+                uint64_t sum = *plane ^ addend ^ carry;
+                carry = (*plane & addend) | (carry & (*plane ^ addend));
+                *plane = sum;
+            }
+        }
+    }
+}
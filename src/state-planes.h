@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2022 - 2023 OSM Group @ HPI, University of Potsdam
+ */
+
+#ifndef STATE_PLANES_H_
+#define STATE_PLANES_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// the states counted per page, as in the histogram
+#define STATE_PLANES_COMMITTED 0
+#define STATE_PLANES_ACCESSED 1
+#define STATE_PLANES_DIRTY 2
+#define STATE_PLANES_STATES 3
+
+// bit-sliced vertical counters of the page states of a range of pages. the
+// counts are kept as planes of one bit per page, 64 pages per limb, so that
+// adding a block of pages is a ripple carry addition of whole limbs straight
+// from the packed page words, and the counts are only expanded into
+// integers at the end.
+class state_planes {
+ public:
+    // whether adding pages is faster than counting their decoded states
+    // byte by byte on this cpu
+    static bool accelerated();
+
+    // counters for pages pages, counting up to max_count
+    state_planes(size_t pages, size_t max_count);
+
+    // add the states of count pages to the counters starting at page. the
+    // pages are packed in words from a word boundary, and the first skip
+    // pages in it are not added.
+    void add(const uint32_t *words, size_t skip, size_t count, size_t page);
+
+    // add the counts of other, with the same number of pages, to these
+    // counters. the sums must not exceed max_count.
+    void merge(const state_planes& other);
+
+    // expand the counts of all pages into integers, on all threads
+    template<typename Counter>
+    void expand(Counter *committed, Counter *accessed, Counter *dirty) const {
+        Counter *counts[STATE_PLANES_STATES] = { committed, accessed, dirty };
+
+        #pragma omp parallel for schedule(static)
+        for (size_t first = 0; first < pages; first += 64) {
+            size_t n = pages - first < 64 ? pages - first : 64;
+            size_t limb = first / 64 + 1;
+
+            for (size_t s = 0; s < STATE_PLANES_STATES; ++s) {
+                Counter limb_counts[64] = { 0 };
+                for (unsigned b = 0; b < bits; ++b) {
+                    uint64_t plane = planes[(s * bits + b) * limbs + limb];
+                    for (size_t j = 0; j < 64; ++j) {
+                        limb_counts[j] |= (Counter)((plane >> j) & 1) << b;
+                    }
+                }
+
+                for (size_t j = 0; j < n; ++j) {
+                    counts[s][first + j] = limb_counts[j];
+                }
+            }
+        }
+    }
+
+ private:
+    size_t pages;
+    size_t limbs;
+    unsigned bits;
+
+    // bit b of state s of limb l at (s * bits + b) * limbs + l. the first
+    // limb is padding, so that blocks starting before their word boundary
+    // never reach below the planes.
+    std::vector<uint64_t> planes;
+
+    // the states of the block being added, (limbs + 1) per state
+    std::vector<uint64_t> masks;
+};
+
+#endif  // STATE_PLANES_H_
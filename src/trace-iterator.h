@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2022 - 2023 OSM Group @ HPI, University of Potsdam
+ */
+
+#ifndef TRACE_ITERATOR_H_
+#define TRACE_ITERATOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./tracefile.h"
+
+// a trace is a sequence of frames, each frame is laid out as
+//
+//   uint32_t sec, usec      timestamp of the frame
+//   uint32_t num_vmas       number of VMA records following
+//
+// followed by num_vmas VMA records of the form
+//
+//   uint64_t start, end     page numbers of the VMA, end is exclusive
+//   uint32_t length         length of the name, including the terminator
+//   char name[length]
+//   uint32_t words[]        2 bits of page state per page, 16 pages per word
+//
+// there is no padding, so the page words are not necessarily aligned.
+
+#define TRACE_FRAME_HEADER_SIZE 12
+#define TRACE_VMA_HEADER_SIZE 20
+
+static inline size_t trace_vma_words(size_t pages) {
+    return (pages * 2 + (32 - 1)) / 32;
+}
+
+// returns the number of bytes occupied by the VMA record at vma
+static inline size_t trace_vma_size(const char *vma) {
+    uint64_t start = *(const uint64_t*)vma;
+    uint64_t end = *(const uint64_t*)(vma + 8);
+    uint32_t length = *(const uint32_t*)(vma + 16);
+
+    return TRACE_VMA_HEADER_SIZE + length + trace_vma_words(end - start) * 4;
+}
+
+// returns the name of the VMA record at vma and stores its length, without
+// the terminator, in length
+static inline const char *trace_vma_name(const char *vma, size_t *length) {
+    uint32_t stored = *(const uint32_t*)(vma + 16);
+    const char *name = vma + TRACE_VMA_HEADER_SIZE;
+
+    // names are stored including their terminator
+    *length = (stored && !name[stored - 1]) ? stored - 1 : stored;
+    return name;
+}
+
+#ifdef __cplusplus
+
+#include <cstddef>
+#include <iterator>
+#include <string_view>
+
+// the id of VMAs read without an index of the interned names
+#define TRACE_VMA_NO_ID UINT32_MAX
+
+struct trace_vma {
+    uint64_t start;
+    uint64_t end;
+    std::string_view name;
+    bool named;  // unnamed VMAs store no name, not even a terminator
+    uint32_t id;  // of the interned name
+    const uint32_t *words;
+
+    size_t num_pages() const {
+        return end - start;
+    }
+
+    size_t num_words() const {
+        return trace_vma_words(num_pages());
+    }
+
+    unsigned state(size_t page) const {
+        return (words[page / 16] >> ((page % 16) * 2)) & 0x3;
+    }
+};
+
+class trace_vma_iterator {
+ public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = trace_vma;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const trace_vma*;
+    using reference = const trace_vma&;
+
+    trace_vma_iterator(const char *position, const uint32_t *ids, uint32_t remaining)
+            : position(position), ids(ids), remaining(remaining), current() {
+        decode();
+    }
+
+    const trace_vma& operator*() const {
+        return current;
+    }
+
+    const trace_vma* operator->() const {
+        return &current;
+    }
+
+    trace_vma_iterator& operator++() {
+        position += trace_vma_size(position);
+        if (ids) {
+            ids++;
+        }
+        remaining--;
+        decode();
+        return *this;
+    }
+
+    bool operator==(trace_vma_iterator const& b) const {
+        return remaining == b.remaining;
+    }
+
+    bool operator!=(trace_vma_iterator const& b) const {
+        return remaining != b.remaining;
+    }
+
+ private:
+    void decode() {
+        if (!remaining) {
+            return;
+        }
+
+        current.start = *(const uint64_t*)position;
+        current.end = *(const uint64_t*)(position + 8);
+
+        size_t length;
+        const char *name = trace_vma_name(position, &length);
+        current.name = std::string_view(name, length);
+        current.id = ids ? *ids : TRACE_VMA_NO_ID;
+
+        uint32_t stored = *(const uint32_t*)(position + 16);
+        current.named = stored != 0;
+        current.words = (const uint32_t*)(position + TRACE_VMA_HEADER_SIZE + stored);
+    }
+
+    const char *position;
+    const uint32_t *ids;
+    uint32_t remaining;
+    trace_vma current;
+};
+
+class trace_frame {
+ public:
+    explicit trace_frame(const char *buffer) : buffer(buffer), ids(nullptr) {}
+
+    trace_frame(const struct smog_tracefile *tracefile, size_t i)
+            : buffer(tracefile->buffer + tracefile->frame_offsets[i]),
+              ids(tracefile->vma_ids ? tracefile->vma_ids + tracefile->frame_first_vma[i]
+                                     : nullptr) {}
+
+    uint32_t sec() const {
+        return *(const uint32_t*)buffer;
+    }
+
+    uint32_t usec() const {
+        return *(const uint32_t*)(buffer + 4);
+    }
+
+    uint32_t num_vmas() const {
+        return *(const uint32_t*)(buffer + 8);
+    }
+
+    trace_vma_iterator begin() const {
+        return trace_vma_iterator(buffer + TRACE_FRAME_HEADER_SIZE, ids, num_vmas());
+    }
+
+    trace_vma_iterator end() const {
+        return trace_vma_iterator(nullptr, nullptr, 0);
+    }
+
+ private:
+    const char *buffer;
+    const uint32_t *ids;
+};
+
+// the name of an interned VMA name id
+static inline std::string_view trace_vma_name(const struct smog_tracefile *tracefile,
+                                              uint32_t id) {
+    size_t length;
+    const char *name = trace_vma_name(tracefile->buffer + tracefile->vma_names[id], &length);
+    return std::string_view(name, length);
+}
+
+#endif  // __cplusplus
+
+#endif  // TRACE_ITERATOR_H_
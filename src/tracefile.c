@@ -13,6 +13,9 @@
 #include <sys/mman.h>
 #include <stdio.h>
 
+#include "./trace-iterator.h"
+#include "./util.h"
+
 int tracefile_open(struct smog_tracefile *tracefile, const char *path) {
     int fd = open(path, O_RDONLY);
     if (fd == -1) {
@@ -42,10 +45,20 @@ int tracefile_open(struct smog_tracefile *tracefile, const char *path) {
 
     tracefile->buffer = buffer;
     tracefile->length = st.st_size;
+    tracefile->mtime = st.st_mtim;
 
     tracefile->frame_offsets = NULL;
+    tracefile->frame_timestamps = NULL;
+    tracefile->frame_num_vmas = NULL;
+    tracefile->frame_lengths = NULL;
+    tracefile->frame_first_vma = NULL;
     tracefile->num_frames = 0;
 
+    tracefile->vma_ids = NULL;
+    tracefile->num_vmas = 0;
+    tracefile->vma_names = NULL;
+    tracefile->num_vma_names = 0;
+
     return 0;
 }
 
@@ -55,55 +68,378 @@ void tracefile_close(struct smog_tracefile *tracefile) {
     tracefile->length = 0;
 
     free(tracefile->frame_offsets);
+    free(tracefile->frame_timestamps);
+    free(tracefile->frame_num_vmas);
+    free(tracefile->frame_lengths);
+    free(tracefile->frame_first_vma);
     tracefile->frame_offsets = NULL;
+    tracefile->frame_timestamps = NULL;
+    tracefile->frame_num_vmas = NULL;
+    tracefile->frame_lengths = NULL;
+    tracefile->frame_first_vma = NULL;
     tracefile->num_frames = 0;
+
+    free(tracefile->vma_ids);
+    free(tracefile->vma_names);
+    tracefile->vma_ids = NULL;
+    tracefile->num_vmas = 0;
+    tracefile->vma_names = NULL;
+    tracefile->num_vma_names = 0;
+}
+
+static int allocate_index(struct smog_tracefile *tracefile, size_t n) {
+    off_t *offsets = realloc(tracefile->frame_offsets, sizeof(*offsets) * n);
+    if (offsets)
+        tracefile->frame_offsets = offsets;
+    uint64_t *timestamps = realloc(tracefile->frame_timestamps, sizeof(*timestamps) * n);
+    if (timestamps)
+        tracefile->frame_timestamps = timestamps;
+    uint32_t *num_vmas = realloc(tracefile->frame_num_vmas, sizeof(*num_vmas) * n);
+    if (num_vmas)
+        tracefile->frame_num_vmas = num_vmas;
+    size_t *lengths = realloc(tracefile->frame_lengths, sizeof(*lengths) * n);
+    if (lengths)
+        tracefile->frame_lengths = lengths;
+    size_t *first_vma = realloc(tracefile->frame_first_vma, sizeof(*first_vma) * n);
+    if (first_vma)
+        tracefile->frame_first_vma = first_vma;
+
+    if (!offsets || !timestamps || !num_vmas || !lengths || !first_vma) {
+        perror("realloc");
+        return 1;
+    }
+
+    return 0;
+}
+
+static int allocate_vma_ids(struct smog_tracefile *tracefile, size_t n) {
+    uint32_t *ids = realloc(tracefile->vma_ids, sizeof(*ids) * n);
+    if (!ids) {
+        perror("realloc");
+        return 1;
+    }
+    tracefile->vma_ids = ids;
+
+    return 0;
+}
+
+static int allocate_vma_names(struct smog_tracefile *tracefile, size_t n) {
+    off_t *names = realloc(tracefile->vma_names, sizeof(*names) * n);
+    if (!names) {
+        perror("realloc");
+        return 1;
+    }
+    tracefile->vma_names = names;
+
+    return 0;
+}
+
+// an open addressing hash table from VMA names to their ids, holding
+// NAME_TABLE_EMPTY in unused slots
+#define NAME_TABLE_EMPTY UINT32_MAX
+
+struct name_table {
+    uint32_t *slots;
+    size_t capacity;  // a power of two
+};
+
+static uint32_t *find_name_slot(const struct smog_tracefile *tracefile,
+                                const struct name_table *table, const char *name,
+                                size_t length) {
+    size_t mask = table->capacity - 1;
+    size_t slot = hash_bytes(name, length) & mask;
+
+    while (table->slots[slot] != NAME_TABLE_EMPTY) {
+        size_t other_length;
+        const char *other = trace_vma_name(
+            tracefile->buffer + tracefile->vma_names[table->slots[slot]], &other_length);
+        if (other_length == length && !memcmp(other, name, length)) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    return &table->slots[slot];
+}
+
+static int grow_name_table(const struct smog_tracefile *tracefile, struct name_table *table) {
+    struct name_table grown;
+    grown.capacity = table->capacity ? table->capacity * 2 : 64;
+    grown.slots = malloc(sizeof(*grown.slots) * grown.capacity);
+    if (!grown.slots) {
+        perror("malloc");
+        return 1;
+    }
+    memset(grown.slots, 0xff, sizeof(*grown.slots) * grown.capacity);
+
+    // reinsert the names known so far
+    for (size_t i = 0; i < tracefile->num_vma_names; ++i) {
+        size_t length;
+        const char *name = trace_vma_name(tracefile->buffer + tracefile->vma_names[i], &length);
+        *find_name_slot(tracefile, &grown, name, length) = i;
+    }
+
+    free(table->slots);
+    *table = grown;
+
+    return 0;
+}
+
+// returns the id of the name of the VMA record at offset, assigning the next
+// id to names not seen before
+static int intern_vma_name(struct smog_tracefile *tracefile, struct name_table *table,
+                           size_t *names_capacity, off_t offset, uint32_t *id) {
+    // keep the table at most half full
+    if (2 * (tracefile->num_vma_names + 1) > table->capacity
+            && grow_name_table(tracefile, table) != 0) {
+        return 1;
+    }
+
+    size_t length;
+    const char *name = trace_vma_name(tracefile->buffer + offset, &length);
+
+    uint32_t *slot = find_name_slot(tracefile, table, name, length);
+    if (*slot == NAME_TABLE_EMPTY) {
+        if (tracefile->num_vma_names == *names_capacity) {
+            *names_capacity = *names_capacity ? *names_capacity * 2 : 64;
+            if (allocate_vma_names(tracefile, *names_capacity) != 0) {
+                return 1;
+            }
+        }
+
+        tracefile->vma_names[tracefile->num_vma_names] = offset;
+        *slot = tracefile->num_vma_names++;
+    }
+
+    *id = *slot;
+
+    return 0;
 }
 
 int tracefile_index_frames(struct smog_tracefile *tracefile) {
-    off_t *offsets = NULL;
+    size_t capacity = 0;
     size_t n = 0;
 
+    size_t vmas_capacity = 0;
+    size_t names_capacity = 0;
+    struct name_table names = { NULL, 0 };
+
+    tracefile->num_vmas = 0;
+    tracefile->num_vma_names = 0;
+
     size_t index = 0;
     while (index < tracefile->length) {
-        // add the current index to the offsets array
-        off_t *new_offsets = realloc(offsets, sizeof(*offsets) * (n + 1));
-        if (!new_offsets) {
-            perror("realloc");
-            free(offsets);
-            return 1;
+        // grow the index geometrically, traces easily have 100k+ frames
+        if (n == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            if (allocate_index(tracefile, capacity) != 0) {
+                free(names.slots);
+                return 1;
+            }
         }
-        offsets = new_offsets;
-        offsets[n++] = index;
 
-        // advance the index over the frame
-        // skip timestamp
-        index += 8;
+        // add the current index to the offsets array
+        tracefile->frame_offsets[n] = index;
+
+        // get the timestamp
+        uint32_t sec = *(uint32_t*)(tracefile->buffer + index);
+        uint32_t usec = *(uint32_t*)(tracefile->buffer + index + 4);
+        tracefile->frame_timestamps[n] = (uint64_t)sec * 1000000 + usec;
 
         // get number of VMAs
-        uint32_t num_vmas = *(uint32_t*)(tracefile->buffer + index);
-        index += 4;
+        uint32_t num_vmas = *(uint32_t*)(tracefile->buffer + index + 8);
+        tracefile->frame_num_vmas[n] = num_vmas;
+        tracefile->frame_first_vma[n] = tracefile->num_vmas;
+        index += TRACE_FRAME_HEADER_SIZE;
+
+        if (tracefile->num_vmas + num_vmas > vmas_capacity) {
+            while (tracefile->num_vmas + num_vmas > vmas_capacity) {
+                vmas_capacity = vmas_capacity ? vmas_capacity * 2 : 16384;
+            }
+            if (allocate_vma_ids(tracefile, vmas_capacity) != 0) {
+                free(names.slots);
+                return 1;
+            }
+        }
 
-        // advance the index over each VMA
+        // advance the index over each VMA, interning its name
         for (uint32_t i = 0; i < num_vmas; ++i) {
-            // get VMA start / end
-            uint64_t lower = *(uint64_t*)(tracefile->buffer + index);
-            uint64_t upper = *(uint64_t*)(tracefile->buffer + index + 8);
-            index += 16;
+            uint32_t *id = &tracefile->vma_ids[tracefile->num_vmas++];
+            if (intern_vma_name(tracefile, &names, &names_capacity, index, id) != 0) {
+                free(names.slots);
+                return 1;
+            }
 
-            size_t pages = upper - lower;
+            index += trace_vma_size(tracefile->buffer + index);
+        }
 
-            // advance the index over the zvma name
-            uint32_t length = *(uint32_t*)(tracefile->buffer + index);
-            index += 4 + length;
+        tracefile->frame_lengths[n] = index - tracefile->frame_offsets[n];
+        n++;
+    }
 
-            // advance the index over the pages
-            size_t words = (pages * 2 + (32 - 1)) / 32;
-            index += words * 4;
-        }
+    free(names.slots);
+
+    tracefile->num_frames = n;
+
+    return 0;
+}
+
+// on-disk layout of the index sidecar. the header is followed by the
+// offsets, timestamps and lengths as uint64_t, the VMA counts as uint32_t,
+// the VMA name ids as uint32_t and the offsets of the interned names as
+// uint64_t.
+#define INDEX_MAGIC "SMOGIDX"
+#define INDEX_VERSION 2
+
+struct index_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t trace_length;
+    int64_t trace_mtime_sec;
+    int64_t trace_mtime_nsec;
+    uint64_t num_frames;
+    uint64_t num_vmas;
+    uint64_t num_vma_names;
+};
+
+_Static_assert(sizeof(off_t) == sizeof(uint64_t), "index stores offsets as uint64_t");
+_Static_assert(sizeof(size_t) == sizeof(uint64_t), "index stores lengths as uint64_t");
+
+int tracefile_load_index(struct smog_tracefile *tracefile, const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return 1;
+    }
+
+    struct index_header header;
+    if (fread(&header, sizeof(header), 1, fp) != 1
+            || memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC))
+            || header.version != INDEX_VERSION
+            || header.trace_length != tracefile->length
+            || header.trace_mtime_sec != tracefile->mtime.tv_sec
+            || header.trace_mtime_nsec != tracefile->mtime.tv_nsec) {
+        // missing, foreign or stale index
+        fclose(fp);
+        return 1;
+    }
+
+    size_t n = header.num_frames;
+    size_t num_vmas = header.num_vmas;
+    size_t num_names = header.num_vma_names;
+    if ((n && allocate_index(tracefile, n) != 0)
+            || (num_vmas && allocate_vma_ids(tracefile, num_vmas) != 0)
+            || (num_names && allocate_vma_names(tracefile, num_names) != 0)) {
+        fclose(fp);
+        return 1;
+    }
+
+    if (fread(tracefile->frame_offsets, sizeof(*tracefile->frame_offsets), n, fp) != n
+            || fread(tracefile->frame_timestamps, sizeof(*tracefile->frame_timestamps), n, fp) != n
+            || fread(tracefile->frame_lengths, sizeof(*tracefile->frame_lengths), n, fp) != n
+            || fread(tracefile->frame_num_vmas, sizeof(*tracefile->frame_num_vmas), n, fp) != n
+            || fread(tracefile->vma_ids, sizeof(*tracefile->vma_ids), num_vmas, fp) != num_vmas
+            || fread(tracefile->vma_names, sizeof(*tracefile->vma_names), num_names, fp)
+                != num_names) {
+        fprintf(stderr, "%s: truncated index file\n", path);
+        fclose(fp);
+        return 1;
+    }
+
+    fclose(fp);
+
+    // the position of the first VMA of each frame follows from the counts
+    size_t first_vma = 0;
+    for (size_t i = 0; i < n; ++i) {
+        tracefile->frame_first_vma[i] = first_vma;
+        first_vma += tracefile->frame_num_vmas[i];
     }
 
-    tracefile->frame_offsets = offsets;
     tracefile->num_frames = n;
+    tracefile->num_vmas = num_vmas;
+    tracefile->num_vma_names = num_names;
+
+    return 0;
+}
+
+int tracefile_save_index(const struct smog_tracefile *tracefile, const char *path) {
+    // write to a temporary file of its own first, so that concurrent or
+    // aborted runs never leave a partial index behind
+    size_t tmplen = strlen(path) + 8;
+    char *tmppath = malloc(tmplen);
+    if (!tmppath) {
+        perror("malloc");
+        return 1;
+    }
+    snprintf(tmppath, tmplen, "%s.XXXXXX", path);
+
+    int fd = mkstemp(tmppath);
+    if (fd == -1) {
+        fprintf(stderr, "%s: ", tmppath);
+        perror("mkstemp");
+        free(tmppath);
+        return 1;
+    }
+
+    // mkstemp creates the file readable by its owner only
+    if (fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) != 0) {
+        fprintf(stderr, "%s: ", tmppath);
+        perror("fchmod");
+        close(fd);
+        unlink(tmppath);
+        free(tmppath);
+        return 1;
+    }
+
+    FILE *fp = fdopen(fd, "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "%s: ", tmppath);
+        perror("fdopen");
+        close(fd);
+        unlink(tmppath);
+        free(tmppath);
+        return 1;
+    }
+
+    struct index_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.version = INDEX_VERSION;
+    header.trace_length = tracefile->length;
+    header.trace_mtime_sec = tracefile->mtime.tv_sec;
+    header.trace_mtime_nsec = tracefile->mtime.tv_nsec;
+    header.num_frames = tracefile->num_frames;
+    header.num_vmas = tracefile->num_vmas;
+    header.num_vma_names = tracefile->num_vma_names;
+
+    size_t n = tracefile->num_frames;
+    size_t num_vmas = tracefile->num_vmas;
+    size_t num_names = tracefile->num_vma_names;
+    if (fwrite(&header, sizeof(header), 1, fp) != 1
+            || fwrite(tracefile->frame_offsets, sizeof(*tracefile->frame_offsets), n, fp) != n
+            || fwrite(tracefile->frame_timestamps, sizeof(*tracefile->frame_timestamps), n, fp) != n
+            || fwrite(tracefile->frame_lengths, sizeof(*tracefile->frame_lengths), n, fp) != n
+            || fwrite(tracefile->frame_num_vmas, sizeof(*tracefile->frame_num_vmas), n, fp) != n
+            || fwrite(tracefile->vma_ids, sizeof(*tracefile->vma_ids), num_vmas, fp) != num_vmas
+            || fwrite(tracefile->vma_names, sizeof(*tracefile->vma_names), num_names, fp)
+                != num_names) {
+        fprintf(stderr, "%s: ", tmppath);
+        perror("fwrite");
+        fclose(fp);
+        unlink(tmppath);
+        free(tmppath);
+        return 1;
+    }
+
+    if (fclose(fp) != 0 || rename(tmppath, path) != 0) {
+        fprintf(stderr, "%s: ", path);
+        perror("rename");
+        unlink(tmppath);
+        free(tmppath);
+        return 1;
+    }
+
+    free(tmppath);
 
     return 0;
 }
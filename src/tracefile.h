@@ -6,14 +6,33 @@
 #define TRACEFILE_H_
 
 #include <stddef.h>
+#include <stdint.h>
+#include <time.h>
 #include <sys/types.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 struct smog_tracefile {
     char *buffer;
     size_t length;
+    struct timespec mtime;
 
     off_t *frame_offsets;
+    uint64_t *frame_timestamps;  // microseconds since the epoch
+    uint32_t *frame_num_vmas;
+    size_t *frame_lengths;
+    size_t *frame_first_vma;     // position of the first VMA of the frame in vma_ids
     size_t num_frames;
+
+    // the names of the VMAs are interned into dense ids while indexing.
+    // vma_ids holds the id of every VMA of every frame in trace order,
+    // vma_names the offset of a VMA record carrying each name.
+    uint32_t *vma_ids;
+    size_t num_vmas;
+    off_t *vma_names;
+    size_t num_vma_names;
 };
 
 int tracefile_open(struct smog_tracefile *tracefile, const char *path);
@@ -22,5 +41,15 @@ void tracefile_close(struct smog_tracefile *tracefile);
 
 int tracefile_index_frames(struct smog_tracefile *tracefile);
 
-#endif  // TRACEFILE_H_
+// the frame index can be persisted to a sidecar file next to the trace. the
+// sidecar is pinned to the size and mtime of the trace, loading a sidecar
+// that does not match the opened trace fails.
+int tracefile_load_index(struct smog_tracefile *tracefile, const char *path);
 
+int tracefile_save_index(const struct smog_tracefile *tracefile, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // TRACEFILE_H_
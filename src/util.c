@@ -82,3 +82,38 @@ const char *format_size_string(size_t s) {
 
     return buffer;
 }
+
+// the 64-bit variant of MurmurHash2 by Austin Appleby, reading 8 bytes per
+// step. see https://github.com/aappleby/smhasher
+uint64_t hash_bytes(const void *data, size_t length) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+
+    const unsigned char *p = data;
+    uint64_t h = 0x8445d61a4e774912ULL ^ (length * m);
+
+    for (; length >= 8; p += 8, length -= 8) {
+        uint64_t k;
+        memcpy(&k, p, sizeof(k));
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    if (length) {
+        uint64_t k = 0;
+        memcpy(&k, p, length);
+        h ^= k;
+        h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+
+    return h;
+}
@@ -6,6 +6,7 @@
 #define UTIL_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -15,6 +16,9 @@ size_t parse_size_string(const char *s);
 
 const char *format_size_string(size_t s);
 
+// a fast, non-cryptographic 64-bit hash of a buffer
+uint64_t hash_bytes(const void *data, size_t length);
+
 #ifdef __cplusplus
 }
 #endif